@@ -0,0 +1,94 @@
+//
+// Run the temporal dithering output stage flat out into a SerialConnection with nothing
+// behind it and see what frame rate it holds. Dithering only looks smooth if frames
+// keep coming fast and evenly, so this prints the frame interval spread as well as
+// the average.
+//
+//     dither_fps [led_count] [seconds] [spi_clock_hz]
+//
+// The frames are a slow, dim ramp, which is what dithering is for. Since there's no
+// strip this is how fast we can make frames, the strip itself can't take them any
+// faster than the wire rate that's printed with it
+//
+#include <iostream>
+#include <string>
+
+#include "../color_bar/neopixel_comms.hh"
+#include "../color_bar/temporal_dither.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+namespace
+{
+
+//
+// Input frames are made up front so making them doesn't show up in the timing
+//
+constexpr size_t UNIQUE_FRAMES = 64;
+
+}
+
+int main(int argc, char **argv)
+{
+    const size_t led_count = argc > 1 ? std::stoul(argv[1]) : 1000;
+    const double seconds = argc > 2 ? std::stod(argv[2]) : 5.0;
+    const double target_clock_hz = argc > 3 ? std::stod(argv[3]) : NeopixelComms::best_spi_clock_hz();
+
+    auto transport = std::make_shared<serial::NullTransport>();
+    serial::SerialConnection serial(transport);
+    NeopixelComms comms(serial.configure_spi_defaults(target_clock_hz));
+    TemporalDither dither(led_count);
+
+    //
+    // A ramp from off up to about 4/255 that slides along the strip
+    //
+    std::vector<std::vector<TemporalDither::Color16>> frames(UNIQUE_FRAMES);
+    for (size_t f = 0; f < UNIQUE_FRAMES; ++f)
+    {
+        frames[f].resize(led_count);
+        for (size_t i = 0; i < led_count; ++i)
+        {
+            const uint16_t level = static_cast<uint16_t>(((i + f * 8) % led_count) * 1024 / led_count);
+            frames[f][i] = TemporalDither::Color16(level, level / 2, level / 4);
+        }
+    }
+
+    //
+    // One frame to get every buffer up to size before timing anything
+    //
+    dither.write_frame(serial, comms, frames[0]);
+    const serial::MetricsSnapshot before = serial.metrics().snapshot();
+
+    size_t frame_count = 0;
+    const uint64_t start_ns = serial::now_ns();
+    const uint64_t end_ns = start_ns + static_cast<uint64_t>(seconds * 1E9);
+    uint64_t now_ns = start_ns;
+    while (now_ns < end_ns)
+    {
+        if (dither.write_frame(serial, comms, frames[frame_count % UNIQUE_FRAMES]) == false)
+        {
+            std::cout << "ERROR: write failed" << std::endl;
+            return 1;
+        }
+        ++frame_count;
+        now_ns = serial::now_ns();
+    }
+
+    const serial::MetricsSnapshot after = serial.metrics().snapshot();
+    std::vector<uint64_t> intervals = after.frame_interval_us;
+    for (size_t i = 0; i < intervals.size(); ++i)
+    {
+        intervals[i] -= before.frame_interval_us[i];
+    }
+
+    const double elapsed_s = (now_ns - start_ns) / 1E9;
+    using Snapshot = serial::MetricsSnapshot;
+    std::cout << led_count << " LEDs, " << frame_count << " frames in " << elapsed_s << "s, "
+              << comms.timing().spi_clock_hz << "Hz clock" << std::endl;
+    std::cout << "  sustained: " << frame_count / elapsed_s << " frames/s" << std::endl;
+    std::cout << "  interval:  p50 " << Snapshot::percentile_us(intervals, 0.5) << "us, p99 "
+              << Snapshot::percentile_us(intervals, 0.99) << "us, p99.9 "
+              << Snapshot::percentile_us(intervals, 0.999) << "us" << std::endl;
+    std::cout << "  wire:      " << 1E9 / comms.frame_wire_time_ns(led_count) << " frames/s max" << std::endl;
+    std::cout << "  sent " << transport->bytes_received() << " bytes" << std::endl;
+    return 0;
+}
@@ -0,0 +1,169 @@
+//
+// Blast sACN or Art-Net at a DmxReceiver over localhost and count what made it. A
+// sender thread plays the lighting console, sending every universe once per frame,
+// and the receiver feeds a LatestFrameOutput with nothing behind it.
+//
+//     dmx_receive [sacn|artnet] [universes] [frame_rate_hz] [seconds]
+//
+// Defaults to 40 sACN universes at 44Hz for 5 seconds. A frame rate of 0 sends as fast
+// as possible. Exits with 1 if any packets went missing
+//
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../color_bar/dmx_receiver.hh"
+#include "../color_bar/frame_output.hh"
+#include "../color_bar/neopixel_comms.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+namespace
+{
+
+//
+// A full universe data packet for `universe`, the sequence number and data get filled
+// in before each send
+//
+std::vector<uint8_t> make_sacn_packet(const uint16_t universe)
+{
+    std::vector<uint8_t> p(638, 0);
+    p[1] = 0x10;
+    const char acn_id[] = "ASC-E1.17";
+    std::memcpy(&p[4], acn_id, 9);
+    p[16] = 0x72;
+    p[17] = 0x6E;
+    p[21] = 0x04;
+    p[38] = 0x72;
+    p[39] = 0x58;
+    p[43] = 0x02;
+    std::memcpy(&p[44], "dmx_receive", 11);
+    p[108] = 100;
+    p[113] = universe >> 8;
+    p[114] = universe & 0xFF;
+    p[115] = 0x72;
+    p[116] = 0x0B;
+    p[117] = 0x02;
+    p[118] = 0xA1;
+    p[122] = 0x01;
+    p[123] = 0x02;
+    p[124] = 0x01;
+    return p;
+}
+
+std::vector<uint8_t> make_artnet_packet(const uint16_t universe)
+{
+    std::vector<uint8_t> p(18 + 512, 0);
+    std::memcpy(&p[0], "Art-Net", 8);
+    p[9] = 0x50;
+    p[11] = 14;
+    p[14] = universe & 0xFF;
+    p[15] = (universe >> 8) & 0x7F;
+    p[16] = 0x02;
+    p[17] = 0x00;
+    return p;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const bool use_artnet = argc > 1 && std::string(argv[1]) == "artnet";
+    const size_t universe_count = argc > 2 ? std::stoul(argv[2]) : 40;
+    const double frame_rate_hz = argc > 3 ? std::stod(argv[3]) : 44.0;
+    const double seconds = argc > 4 ? std::stod(argv[4]) : 5.0;
+
+    const DmxReceiver::Protocol protocol = use_artnet ? DmxReceiver::Protocol::ARTNET : DmxReceiver::Protocol::SACN;
+    const uint16_t port = use_artnet ? DmxReceiver::ARTNET_PORT : DmxReceiver::SACN_PORT;
+    const size_t led_count = universe_count * DmxReceiver::LEDS_PER_UNIVERSE;
+
+    auto transport = std::make_shared<serial::NullTransport>();
+    serial::SerialConnection serial(transport);
+    NeopixelComms comms(serial.configure_spi_defaults(NeopixelComms::best_spi_clock_hz()));
+    LatestFrameOutput output(serial, comms, led_count);
+
+    DmxReceiver receiver(protocol, DmxReceiver::contiguous_mapping(led_count, 1), output, port, "127.0.0.1");
+    if (receiver.is_open() == false)
+    {
+        return 1;
+    }
+    std::thread receive_thread(&DmxReceiver::run, &receiver);
+
+    //
+    // The console
+    //
+    const int send_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in destination;
+    std::memset(&destination, 0, sizeof(destination));
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &destination.sin_addr);
+
+    std::vector<std::vector<uint8_t>> packets;
+    for (size_t u = 0; u < universe_count; ++u)
+    {
+        packets.push_back(use_artnet ? make_artnet_packet(u + 1) : make_sacn_packet(u + 1));
+    }
+    const size_t sequence_offset = use_artnet ? 12 : 111;
+    const size_t data_offset = use_artnet ? 18 : 126;
+
+    size_t frames_sent = 0;
+    size_t packets_sent = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration<double>(seconds);
+    auto next_frame = start;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        for (std::vector<uint8_t> &packet : packets)
+        {
+            packet[sequence_offset] = static_cast<uint8_t>(frames_sent + 1);
+            std::memset(&packet[data_offset], static_cast<int>(frames_sent & 0xFF), 510);
+            if (sendto(send_fd, packet.data(), packet.size(), 0, reinterpret_cast<const sockaddr *>(&destination),
+                       sizeof(destination)) == static_cast<ssize_t>(packet.size()))
+            {
+                ++packets_sent;
+            }
+        }
+        ++frames_sent;
+
+        if (frame_rate_hz > 0.0)
+        {
+            next_frame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / frame_rate_hz));
+            std::this_thread::sleep_until(next_frame);
+        }
+    }
+    const double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    //
+    // Let the receiver catch up on anything still sitting in the socket
+    //
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    receiver.stop();
+    receive_thread.join();
+    close(send_fd);
+
+    const DmxReceiver::Stats stats = receiver.stats();
+    const LatestFrameOutput::Stats output_stats = output.stats();
+    const std::vector<uint64_t> latency = receiver.publish_latency().buckets();
+    using Snapshot = serial::MetricsSnapshot;
+
+    std::cout << (use_artnet ? "Art-Net" : "sACN") << ", " << universe_count << " universes, " << frames_sent
+              << " frames in " << elapsed_s << "s (" << packets_sent / elapsed_s << " packets/s)" << std::endl;
+    std::cout << "  packets:   sent " << packets_sent << ", received " << stats.packets << ", lost "
+              << packets_sent - stats.packets << ", out of order " << stats.out_of_order << ", ignored "
+              << stats.ignored_packets << std::endl;
+    std::cout << "  batches:   " << stats.batches << ", " << static_cast<double>(stats.packets) / stats.batches
+              << " packets per batch on average, " << stats.largest_batch << " at most" << std::endl;
+    std::cout << "  frames:    published " << stats.frames_published << ", written " << output_stats.frames_written
+              << ", skipped by the output " << output_stats.frames_skipped << std::endl;
+    std::cout << "  first packet to publish: p50 " << Snapshot::percentile_us(latency, 0.5) << "us, p99 "
+              << Snapshot::percentile_us(latency, 0.99) << "us" << std::endl;
+
+    return stats.packets == packets_sent ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+//
+// Renders the same stack of effects two ways: fused through the effects expression
+// templates (one loop over the LEDs), and chained, with every effect and every operator
+// as its own pass over a full strip of intermediate colors. It prints how fast each one
+// goes and checks that both made exactly the same bytes.
+//
+//     effects_fused [led_count] [frame_count]
+//
+// Defaults to 1000 LEDs for 5000 frames. Exits with 1 if any frame came out different
+//
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../color_bar/effects.hh"
+#include "../ftd2xx_driver/metrics.hh"
+
+namespace
+{
+
+using namespace animations::effects;
+
+//
+// A strip's worth of light in between passes
+//
+using Layer = std::vector<Rgb>;
+
+template <typename E>
+void chained_leaf(const Effect<E> &effect, Layer &out)
+{
+    const E &e = effect.self();
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+        out[i] = e(i, out.size());
+    }
+}
+
+void chained_multiply(const Layer &lhs, const Layer &rhs, Layer &out)
+{
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+        out[i] = lhs[i] * rhs[i];
+    }
+}
+
+void chained_add(const Layer &lhs, const Layer &rhs, Layer &out)
+{
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+        out[i] = lhs[i] + rhs[i];
+    }
+}
+
+void chained_to_bytes(const Layer &layer, animations::Color *colors)
+{
+    for (size_t i = 0; i < layer.size(); ++i)
+    {
+        colors[i] = animations::Color(to_byte(layer[i].r), to_byte(layer[i].g), to_byte(layer[i].b));
+    }
+}
+
+//
+// Time goes from 0 to 10 seconds over the run, so the pulse moves
+//
+double frame_time_s(const size_t frame, const size_t frame_count)
+{
+    return 10.0 * frame / frame_count;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const size_t led_count = argc > 1 ? std::stoul(argv[1]) : 1000;
+    const size_t frame_count = argc > 2 ? std::stoul(argv[2]) : 5000;
+
+    //
+    // gradient(BLUE, WHITE) * pulse(t) + solid(RED) * mask(0, led_count / 10)
+    //     + 0.5 * gradient(RED, GREEN) * percent_mask(0.5)
+    //
+    const auto expression = [led_count](const double t)
+    {
+        return gradient(animations::BLUE, animations::WHITE) * pulse(t) +
+               solid(animations::RED) * mask(0, led_count / 10) +
+               0.5f * gradient(animations::RED, animations::GREEN) * percent_mask(0.5);
+    };
+
+    std::vector<animations::Color> fused(led_count);
+    std::vector<animations::Color> chained(led_count);
+    std::vector<Layer> layers(4, Layer(led_count));
+    Layer &a = layers[0];
+    Layer &b = layers[1];
+    Layer &c = layers[2];
+    Layer &d = layers[3];
+
+    uint64_t fused_ns = 0;
+    uint64_t chained_ns = 0;
+    size_t mismatches = 0;
+    for (size_t frame = 0; frame < frame_count; ++frame)
+    {
+        const double t = frame_time_s(frame, frame_count);
+
+        uint64_t start_ns = serial::now_ns();
+        render(expression(t), fused.data(), led_count);
+        fused_ns += serial::now_ns() - start_ns;
+
+        //
+        // The same tree, one pass per node. The operations happen in the same order
+        // as the fused version, so the floats come out the same
+        //
+        start_ns = serial::now_ns();
+        chained_leaf(gradient(animations::BLUE, animations::WHITE), a);
+        chained_leaf(pulse(t), b);
+        chained_multiply(a, b, a);
+        chained_leaf(solid(animations::RED), b);
+        chained_leaf(mask(0, led_count / 10), c);
+        chained_multiply(b, c, b);
+        chained_add(a, b, a);
+        chained_leaf(constant(0.5f), b);
+        chained_leaf(gradient(animations::RED, animations::GREEN), c);
+        chained_multiply(b, c, b);
+        chained_leaf(percent_mask(0.5), d);
+        chained_multiply(b, d, b);
+        chained_add(a, b, a);
+        chained_to_bytes(a, chained.data());
+        chained_ns += serial::now_ns() - start_ns;
+
+        if (std::memcmp(fused.data(), chained.data(), led_count * sizeof(animations::Color)) != 0)
+        {
+            ++mismatches;
+        }
+    }
+
+    std::cout << led_count << " LEDs, " << frame_count << " frames" << std::endl;
+    std::cout << "  fused:   " << frame_count * 1E9 / fused_ns << " frames/s" << std::endl;
+    std::cout << "  chained: " << frame_count * 1E9 / chained_ns << " frames/s" << std::endl;
+    std::cout << "  " << mismatches << " frames didn't match" << std::endl;
+    std::cout << (mismatches == 0 ? "PASSED" : "FAILED") << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
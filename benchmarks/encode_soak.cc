@@ -0,0 +1,116 @@
+//
+// Encode a bunch of random frames, push them through a SerialConnection into the
+// Neopixel simulator and make sure every frame decodes back to exactly what went in.
+// Prints how fast the encoder and the simulator went so an encoder change can be
+// checked for correctness and speed in one run.
+//
+//     encode_soak [led_count] [frame_count] [spi_clock_hz]
+//
+// The clock defaults to NeopixelComms::best_spi_clock_hz(). Exits with 1 if anything
+// didn't decode cleanly
+//
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "../color_bar/neopixel_comms.hh"
+#include "../color_bar/neopixel_simulator.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+namespace
+{
+
+//
+// Random frames are made up front so the RNG doesn't show up in the timing
+//
+constexpr size_t UNIQUE_FRAMES = 16;
+
+bool same_colors(const std::vector<animations::Color> &a, const std::vector<animations::Color> &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (a[i].R != b[i].R || a[i].G != b[i].G || a[i].B != b[i].B)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const size_t led_count = argc > 1 ? std::stoul(argv[1]) : 1000;
+    const size_t frame_count = argc > 2 ? std::stoul(argv[2]) : 5000;
+    const double target_clock_hz = argc > 3 ? std::stod(argv[3]) : NeopixelComms::best_spi_clock_hz();
+
+    auto simulator = std::make_shared<NeopixelSimulator>();
+    serial::SerialConnection serial(simulator);
+    NeopixelComms comms(serial.configure_spi_defaults(target_clock_hz));
+
+    std::mt19937 rng(1234);
+    std::vector<animations::Frame> frames(UNIQUE_FRAMES);
+    for (animations::Frame &frame : frames)
+    {
+        for (size_t i = 0; i < led_count; ++i)
+        {
+            frame.colors.emplace_back(rng() & 0xFF, rng() & 0xFF, rng() & 0xFF);
+        }
+    }
+
+    //
+    // Check every frame as soon as it latches
+    //
+    const animations::Frame *expected = nullptr;
+    size_t mismatches = 0;
+    simulator->set_frame_callback(
+        [&expected, &mismatches](const std::vector<animations::Color> &colors, uint64_t)
+        {
+            if (expected == nullptr || same_colors(colors, expected->colors) == false)
+            {
+                ++mismatches;
+            }
+        });
+
+    uint64_t encode_ns = 0;
+    uint64_t write_ns = 0;
+    const uint64_t frames_before = simulator->stats().frames;
+    for (size_t i = 0; i < frame_count; ++i)
+    {
+        expected = &frames[i % UNIQUE_FRAMES];
+
+        const uint64_t start_ns = serial::now_ns();
+        serial::ByteVector_t encoded = comms.build_frame(*expected);
+        const uint64_t encoded_ns = serial::now_ns();
+        serial.spi_write_data(std::move(encoded));
+        const uint64_t written_ns = serial::now_ns();
+
+        encode_ns += encoded_ns - start_ns;
+        write_ns += written_ns - encoded_ns;
+    }
+
+    const NeopixelSimulator::Stats &stats = simulator->stats();
+    const uint64_t frames_latched = stats.frames - frames_before;
+    const NeopixelComms::SymbolTiming &timing = comms.timing();
+
+    std::cout << led_count << " LEDs, " << frame_count << " frames, " << timing.spi_clock_hz << "Hz clock, "
+              << timing.symbol_bits << " bits per symbol" << std::endl;
+    std::cout << "  encode:    " << frame_count * 1E9 / encode_ns << " frames/s" << std::endl;
+    std::cout << "  simulate:  " << frame_count * 1E9 / write_ns << " frames/s" << std::endl;
+    std::cout << "  wire:      " << 1E9 / comms.frame_wire_time_ns(led_count) << " frames/s max" << std::endl;
+    std::cout << "  latched " << frames_latched << ", mismatched " << mismatches
+              << ", timing errors " << stats.timing_errors
+              << ", latch violations " << stats.latch_violations
+              << ", partial pixels " << stats.partial_pixels
+              << ", bad commands " << stats.bad_commands << std::endl;
+
+    const bool clean = frames_latched == frame_count && mismatches == 0 && stats.timing_errors == 0 &&
+                       stats.latch_violations == 0 && stats.partial_pixels == 0 && stats.bad_commands == 0;
+    std::cout << (clean ? "PASSED" : "FAILED") << std::endl;
+    return clean ? 0 : 1;
+}
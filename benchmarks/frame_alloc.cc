@@ -0,0 +1,123 @@
+//
+// Counts heap allocations while generating and playing percent bar ramps over and over,
+// the way a long running meter does. The old path makes new frames and encode buffers
+// every time, the _into/FramePool path reuses them and should settle at zero
+// allocations per ramp once it's warmed up.
+//
+//     frame_alloc [led_count] [ramp_count] [step_count]
+//
+// Frames go to a SerialConnection with nothing behind it and aren't held, so this also
+// shows how much the allocations were costing. Exits with 1 if the steady state
+// allocates
+//
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "../color_bar/frame_pool.hh"
+#include "../color_bar/neopixel_comms.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+namespace
+{
+
+std::atomic<uint64_t> allocation_count(0);
+
+//
+// Ramps the warm up gets before anything is counted
+//
+constexpr size_t WARM_UP_RAMPS = 4;
+
+}
+
+//
+// Every new in the program comes through here
+//
+void *operator new(size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void *pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+int main(int argc, char **argv)
+{
+    const size_t led_count = argc > 1 ? std::stoul(argv[1]) : 1000;
+    const size_t ramp_count = argc > 2 ? std::stoul(argv[2]) : 200;
+    const size_t step_count = argc > 3 ? std::stoul(argv[3]) : 100;
+
+    auto transport = std::make_shared<serial::NullTransport>();
+    serial::SerialConnection serial(transport);
+    auto comms = std::make_shared<NeopixelComms>(serial.configure_spi_defaults(NeopixelComms::best_spi_clock_hz()));
+
+    //
+    // The old way, everything is new every ramp
+    //
+    uint64_t allocations_before = allocation_count;
+    uint64_t start_ns = serial::now_ns();
+    for (size_t i = 0; i < ramp_count; ++i)
+    {
+        const std::vector<animations::Frame> frames =
+            animations::green_percent_bar_ramp(0.0, (i % 10) / 10.0, led_count, 0, step_count);
+        animations::play_frames(frames, comms, serial);
+    }
+    const double fresh_ns = static_cast<double>(serial::now_ns() - start_ns) / ramp_count;
+    const double fresh_allocations = static_cast<double>(allocation_count - allocations_before) / ramp_count;
+
+    //
+    // Reusing frames and buffers. The frames go back to a pool in between ramps like
+    // they would if something else was holding on to them for a bit
+    //
+    animations::FramePool pool(led_count);
+    animations::PlaybackBuffers buffers;
+    std::vector<animations::Frame> frames;
+    frames.reserve(step_count + 1);
+    uint64_t steady_allocations = 0;
+    uint64_t steady_ns = 0;
+    for (size_t i = 0; i < ramp_count + WARM_UP_RAMPS; ++i)
+    {
+        allocations_before = allocation_count;
+        start_ns = serial::now_ns();
+
+        for (size_t step = 0; step <= step_count; ++step)
+        {
+            frames.push_back(pool.acquire());
+        }
+        animations::green_percent_bar_ramp_into(0.0, (i % 10) / 10.0, led_count, 0, step_count, frames);
+        animations::play_frames(frames, comms, serial, buffers);
+        pool.release(frames);
+
+        if (i >= WARM_UP_RAMPS)
+        {
+            steady_ns += serial::now_ns() - start_ns;
+            steady_allocations += allocation_count - allocations_before;
+        }
+    }
+
+    std::cout << led_count << " LEDs, " << ramp_count << " ramps of " << step_count + 1 << " frames" << std::endl;
+    std::cout << "  fresh frames:  " << fresh_allocations << " allocations/ramp, " << fresh_ns / 1E6
+              << " ms/ramp" << std::endl;
+    std::cout << "  pooled frames: " << static_cast<double>(steady_allocations) / ramp_count
+              << " allocations/ramp, " << static_cast<double>(steady_ns) / ramp_count / 1E6 << " ms/ramp"
+              << std::endl;
+
+    const bool clean = steady_allocations == 0;
+    std::cout << (clean ? "PASSED" : "FAILED") << std::endl;
+    return clean ? 0 : 1;
+}
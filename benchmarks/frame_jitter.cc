@@ -0,0 +1,267 @@
+//
+// How close play_frames gets to the hold times it's asked for. The frames go out through
+// a SerialConnection whose transport takes a random amount of time for every write, like
+// a USB bus that's sometimes busy, and the time each write finishes is when that frame
+// counts as shown. The gaps between those are compared against each frame's
+// hold_time_ms, so a change to the scheduling or sleeping can be judged on how steady
+// the frames are and not just on how many go out.
+//
+//     frame_jitter [fixed|uniform|normal|lognormal] [latency_us] [spread_us] [hold_time_ms]
+//                  [frame_count] [led_count]
+//
+// `latency_us` is the mean write latency and `spread_us` is how far it wanders: the half
+// width for uniform and the standard deviation for normal and lognormal. Defaults to
+// lognormal 2000us +- 1000us, 16ms holds, 500 frames of 300 LEDs
+//
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../color_bar/animations.hh"
+#include "../color_bar/neopixel_comms.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+namespace
+{
+
+//
+// A transport that takes a while. Every write blocks for a latency drawn from the
+// model, and when `recording` is on the time each write finished is kept
+//
+class LatencyModelTransport final : public serial::TransportBase
+{
+public: // types //////////////////////////////////////////////////////////////
+    enum class Model
+    {
+        FIXED,
+        UNIFORM,
+        NORMAL,
+        LOGNORMAL
+    };
+
+public: // constructor ////////////////////////////////////////////////////////
+    LatencyModelTransport(const Model model_, const double latency_us_, const double spread_us_)
+        : recording(false),
+          model(model_),
+          latency_us(latency_us_),
+          spread_us(spread_us_),
+          rng(1234)
+    {
+        //
+        // Pick the lognormal's parameters so its mean and deviation come out as asked
+        //
+        const double variance = std::log(1.0 + (spread_us * spread_us) / (latency_us * latency_us));
+        lognormal = std::lognormal_distribution<double>(std::log(latency_us) - variance / 2.0, std::sqrt(variance));
+    }
+
+public: // methods ////////////////////////////////////////////////////////////
+    FT_STATUS write(const BYTE *, const size_t size, DWORD &bytes_written) override
+    {
+        const uint64_t latency_ns = next_latency_us() * 1E3;
+        const uint64_t done_ns = serial::now_ns() + latency_ns;
+
+        //
+        // Spin instead of sleeping, the sleep's own jitter would end up in the results
+        //
+        while (serial::now_ns() < done_ns)
+        {
+        }
+
+        if (recording)
+        {
+            latencies_ns.push_back(latency_ns);
+            finished_ns.push_back(serial::now_ns());
+        }
+        bytes_written = size;
+        return FT_OK;
+    }
+
+public: // members ////////////////////////////////////////////////////////////
+    bool recording;
+    std::vector<uint64_t> latencies_ns;
+    std::vector<uint64_t> finished_ns;
+
+private: // methods ///////////////////////////////////////////////////////////
+    double next_latency_us()
+    {
+        switch (model)
+        {
+        case Model::FIXED:
+            return latency_us;
+        case Model::UNIFORM:
+            return std::max(0.0, std::uniform_real_distribution<double>(latency_us - spread_us,
+                                                                        latency_us + spread_us)(rng));
+        case Model::NORMAL:
+            return std::max(0.0, std::normal_distribution<double>(latency_us, spread_us)(rng));
+        case Model::LOGNORMAL:
+            return lognormal(rng);
+        }
+        return latency_us;
+    }
+
+private: // members ///////////////////////////////////////////////////////////
+    Model model;
+    double latency_us;
+    double spread_us;
+    std::mt19937 rng;
+    std::lognormal_distribution<double> lognormal;
+};
+
+bool parse_model(const std::string &name, LatencyModelTransport::Model &model)
+{
+    using Model = LatencyModelTransport::Model;
+    if (name == "fixed")
+    {
+        model = Model::FIXED;
+    }
+    else if (name == "uniform")
+    {
+        model = Model::UNIFORM;
+    }
+    else if (name == "normal")
+    {
+        model = Model::NORMAL;
+    }
+    else if (name == "lognormal")
+    {
+        model = Model::LOGNORMAL;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+//
+// Summary of a bunch of samples (in microseconds)
+//
+struct Distribution
+{
+    double mean = 0.0;
+    double stddev = 0.0;
+    double min = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+Distribution distribution(std::vector<double> samples)
+{
+    Distribution d;
+    if (samples.empty())
+    {
+        return d;
+    }
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+    for (const double sample : samples)
+    {
+        sum += sample;
+    }
+    d.mean = sum / samples.size();
+
+    double squares = 0.0;
+    for (const double sample : samples)
+    {
+        squares += (sample - d.mean) * (sample - d.mean);
+    }
+    d.stddev = std::sqrt(squares / samples.size());
+
+    const auto at = [&samples](const double p)
+    { return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))]; };
+    d.min = samples.front();
+    d.p50 = at(0.5);
+    d.p90 = at(0.9);
+    d.p99 = at(0.99);
+    d.max = samples.back();
+    return d;
+}
+
+void print_distribution(const std::string &name, const Distribution &d)
+{
+    std::cout << "  " << name << "mean " << d.mean << ", stddev " << d.stddev << ", min " << d.min << ", p50 "
+              << d.p50 << ", p90 " << d.p90 << ", p99 " << d.p99 << ", max " << d.max << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const std::string model_name = argc > 1 ? argv[1] : "lognormal";
+    const double latency_us = argc > 2 ? std::stod(argv[2]) : 2000.0;
+    const double spread_us = argc > 3 ? std::stod(argv[3]) : 1000.0;
+    const unsigned long hold_time_ms = argc > 4 ? std::stoul(argv[4]) : 16;
+    const size_t frame_count = argc > 5 ? std::stoul(argv[5]) : 500;
+    const size_t led_count = argc > 6 ? std::stoul(argv[6]) : 300;
+
+    LatencyModelTransport::Model model;
+    if (parse_model(model_name, model) == false || latency_us <= 0.0 || frame_count < 2)
+    {
+        std::cout << "usage: frame_jitter [fixed|uniform|normal|lognormal] [latency_us] [spread_us] "
+                     "[hold_time_ms] [frame_count] [led_count]"
+                  << std::endl;
+        return 1;
+    }
+
+    auto transport = std::make_shared<LatencyModelTransport>(model, latency_us, spread_us);
+    serial::SerialConnection serial(transport);
+    auto comms = std::make_shared<NeopixelComms>(serial.configure_spi_defaults(NeopixelComms::best_spi_clock_hz()));
+
+    std::vector<animations::Frame> frames =
+        animations::green_percent_bar_ramp(0.0, 1.0, led_count, frame_count * hold_time_ms, frame_count - 1);
+    for (animations::Frame &frame : frames)
+    {
+        frame.hold_time_ms = hold_time_ms;
+    }
+
+    //
+    // Only frames get recorded, not the setup writes
+    //
+    transport->recording = true;
+    animations::play_frames(frames, comms, serial);
+    transport->recording = false;
+
+    const std::vector<uint64_t> &finished_ns = transport->finished_ns;
+    std::vector<double> latencies_us;
+    for (const uint64_t latency_ns : transport->latencies_ns)
+    {
+        latencies_us.push_back(latency_ns / 1E3);
+    }
+
+    //
+    // Frame i is held from when it finished until frame i + 1 finished, and it asked for
+    // its own hold time
+    //
+    std::vector<double> intervals_us;
+    std::vector<double> errors_us;
+    std::vector<double> abs_errors_us;
+    uint64_t requested_ns = 0;
+    for (size_t i = 1; i < finished_ns.size(); ++i)
+    {
+        const double interval_us = (finished_ns[i] - finished_ns[i - 1]) / 1E3;
+        const double error_us = interval_us - frames[i - 1].hold_time_ms * 1E3;
+        intervals_us.push_back(interval_us);
+        errors_us.push_back(error_us);
+        abs_errors_us.push_back(std::abs(error_us));
+        requested_ns += frames[i - 1].hold_time_ms * 1000000;
+    }
+    const size_t late_frames = std::count_if(errors_us.begin(), errors_us.end(), [](double e) { return e > 1000.0; });
+    const double drift_ms = (static_cast<double>(finished_ns.back() - finished_ns.front()) - requested_ns) / 1E6;
+
+    std::cout << finished_ns.size() << " frames of " << led_count << " LEDs held " << hold_time_ms << "ms, "
+              << model_name << " write latency " << latency_us << "us +- " << spread_us << "us" << std::endl;
+    std::cout << "  (all times in us)" << std::endl;
+    print_distribution("write latency:  ", distribution(latencies_us));
+    print_distribution("frame interval: ", distribution(intervals_us));
+    print_distribution("interval error: ", distribution(errors_us));
+    print_distribution("|error|:        ", distribution(abs_errors_us));
+    std::cout << "  " << late_frames << " frames more than 1ms late, " << drift_ms << "ms total drift over "
+              << requested_ns / 1E6 << "ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,145 @@
+//
+// Run an OpcServer and point a few local clients at it, each one streaming whole frames
+// like a render process would. Checks that every message made it and prints how many
+// frames the server coalesced them into.
+//
+//     opc_clients [clients] [led_count] [frame_rate_hz] [seconds]
+//
+// Defaults to 4 clients sending 1000 LEDs at 60Hz for 5 seconds. A frame rate of 0
+// sends as fast as possible. Exits with 1 if any messages went missing
+//
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../color_bar/frame_output.hh"
+#include "../color_bar/neopixel_comms.hh"
+#include "../color_bar/opc_server.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+namespace
+{
+
+constexpr uint16_t PORT = 17890;
+
+//
+// Send frames until `seconds` are up, returns how many went out
+//
+size_t run_client(const size_t client_number, const size_t led_count, const double frame_rate_hz,
+                  const double seconds)
+{
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in server;
+    std::memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(PORT);
+    inet_pton(AF_INET, "127.0.0.1", &server.sin_addr);
+    if (connect(fd, reinterpret_cast<const sockaddr *>(&server), sizeof(server)) != 0)
+    {
+        std::cout << "ERROR: client " << client_number << " couldn't connect" << std::endl;
+        close(fd);
+        return 0;
+    }
+
+    std::vector<uint8_t> message(4 + 3 * led_count);
+    message[2] = (3 * led_count) >> 8;
+    message[3] = (3 * led_count) & 0xFF;
+
+    size_t sent = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::duration<double>(seconds);
+    auto next_frame = start;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        std::memset(&message[4], static_cast<int>((sent + client_number) & 0xFF), 3 * led_count);
+
+        size_t offset = 0;
+        while (offset < message.size())
+        {
+            const ssize_t written = send(fd, &message[offset], message.size() - offset, MSG_NOSIGNAL);
+            if (written <= 0)
+            {
+                close(fd);
+                return sent;
+            }
+            offset += written;
+        }
+        ++sent;
+
+        if (frame_rate_hz > 0.0)
+        {
+            next_frame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / frame_rate_hz));
+            std::this_thread::sleep_until(next_frame);
+        }
+    }
+
+    close(fd);
+    return sent;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const size_t client_count = argc > 1 ? std::stoul(argv[1]) : 4;
+    const size_t led_count = argc > 2 ? std::stoul(argv[2]) : 1000;
+    const double frame_rate_hz = argc > 3 ? std::stod(argv[3]) : 60.0;
+    const double seconds = argc > 4 ? std::stod(argv[4]) : 5.0;
+
+    auto transport = std::make_shared<serial::NullTransport>();
+    serial::SerialConnection serial(transport);
+    NeopixelComms comms(serial.configure_spi_defaults(NeopixelComms::best_spi_clock_hz()));
+    LatestFrameOutput output(serial, comms, led_count);
+
+    OpcServer server(output, PORT, "127.0.0.1");
+    if (server.is_open() == false)
+    {
+        return 1;
+    }
+    std::thread server_thread(&OpcServer::run, &server);
+
+    std::vector<std::thread> clients;
+    std::vector<size_t> sent(client_count, 0);
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < client_count; ++i)
+    {
+        clients.emplace_back([&sent, i, led_count, frame_rate_hz, seconds]
+                             { sent[i] = run_client(i, led_count, frame_rate_hz, seconds); });
+    }
+    for (std::thread &client : clients)
+    {
+        client.join();
+    }
+    const double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    //
+    // Give the server a moment to read whatever's still in the sockets
+    //
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    server.stop();
+    server_thread.join();
+
+    size_t total_sent = 0;
+    for (const size_t s : sent)
+    {
+        total_sent += s;
+    }
+
+    const OpcServer::Stats stats = server.stats();
+    const LatestFrameOutput::Stats output_stats = output.stats();
+    std::cout << client_count << " clients, " << led_count << " LEDs, " << elapsed_s << "s" << std::endl;
+    std::cout << "  messages:  sent " << total_sent << ", received " << stats.messages << " ("
+              << stats.messages / elapsed_s << "/s, " << stats.bytes / elapsed_s / 1E6 << " MB/s)" << std::endl;
+    std::cout << "  frames:    published " << stats.frames_published << ", written " << output_stats.frames_written
+              << ", skipped by the output " << output_stats.frames_skipped << std::endl;
+
+    return stats.messages == total_sent ? 0 : 1;
+}
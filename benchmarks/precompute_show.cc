@@ -0,0 +1,109 @@
+//
+// How long it takes to precompute a long show, one thread against the ThreadPool, and
+// that both make exactly the same frames. The default is a 10 minute show for 20k LEDs
+// at 30 frames a second, which is about as fast as a strip that long can go anyway
+// (and is about 1.4GB of colors, so it needs the memory for two of those).
+//
+//     precompute_show [led_count] [duration_s] [frame_rate_hz] [thread_count]
+//
+// Exits with 1 if the parallel frames didn't match
+//
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "../color_bar/parallel_animations.hh"
+#include "../ftd2xx_driver/metrics.hh"
+
+namespace
+{
+
+bool same_frames(const std::vector<animations::Frame> &frames, const animations::FrameSequence &sequence)
+{
+    if (frames.size() != sequence.frame_count())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        const animations::Color *expected = sequence.data() + i * sequence.led_count();
+        if (frames[i].colors.size() != sequence.led_count() ||
+            std::memcmp(frames[i].colors.data(), expected, sequence.led_count() * sizeof(animations::Color)) != 0 ||
+            frames[i].hold_time_ms != sequence.hold_times_ms()[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const size_t led_count = argc > 1 ? std::stoul(argv[1]) : 20000;
+    const double duration_s = argc > 2 ? std::stod(argv[2]) : 600.0;
+    const double frame_rate_hz = argc > 3 ? std::stod(argv[3]) : 30.0;
+    const size_t thread_count = argc > 4 ? std::stoul(argv[4]) : 0;
+
+    const size_t step_count = duration_s * frame_rate_hz;
+    const unsigned long duration_ms = duration_s * 1E3;
+
+    animations::ThreadPool pool(thread_count);
+    std::cout << led_count << " LEDs, " << step_count + 1 << " frames, " << pool.thread_count() << " threads"
+              << std::endl;
+
+    animations::Frame start;
+    animations::Frame end;
+    for (size_t i = 0; i < led_count; ++i)
+    {
+        start.colors.emplace_back(i & 0xFF, 0, 255 - (i & 0xFF));
+        end.colors.emplace_back(0, 255 - (i & 0xFF), i & 0xFF);
+    }
+
+    bool matched = true;
+    for (const std::string animation : {"ramp", "fade"})
+    {
+        //
+        // Each one gets thrown away before the next starts, so only two shows are ever
+        // in memory
+        //
+        uint64_t serial_ns = 0;
+        uint64_t parallel_ns = 0;
+        bool same = false;
+        {
+            std::vector<animations::Frame> frames;
+            uint64_t start_ns = serial::now_ns();
+            if (animation == "ramp")
+            {
+                animations::green_percent_bar_ramp_into(0.0, 1.0, led_count, duration_ms, step_count, frames);
+            }
+            else
+            {
+                animations::fade_into(start, end, duration_ms, step_count, frames);
+            }
+            serial_ns = serial::now_ns() - start_ns;
+
+            animations::FrameSequence sequence(led_count);
+            start_ns = serial::now_ns();
+            if (animation == "ramp")
+            {
+                animations::green_percent_bar_ramp_into(pool, 0.0, 1.0, led_count, duration_ms, step_count, sequence);
+            }
+            else
+            {
+                animations::fade_into(pool, start, end, duration_ms, step_count, sequence);
+            }
+            parallel_ns = serial::now_ns() - start_ns;
+
+            same = same_frames(frames, sequence);
+        }
+
+        std::cout << "  " << animation << ": one thread " << serial_ns / 1E9 << "s, pool " << parallel_ns / 1E9
+                  << "s, " << (same ? "same frames" : "FRAMES DIFFER") << std::endl;
+        matched = matched && same;
+    }
+
+    std::cout << (matched ? "PASSED" : "FAILED") << std::endl;
+    return matched ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+//
+// How long a frame takes from a producer publishing it into shared memory to it being
+// written out by the driver side. The producer runs on its own thread (a real one would
+// be another process, the path is the same) and the consumer spins on the channel,
+// encodes if it has to and writes through a SerialConnection with nothing behind it.
+//
+//     shm_latency [pixels|wire] [led_count] [frame_count] [frame_rate_hz]
+//
+// Defaults to 1000 LEDs in pixel format, 5000 frames at 1000Hz
+//
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../color_bar/neopixel_comms.hh"
+#include "../color_bar/shm_channel.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+namespace
+{
+
+const std::string CHANNEL_NAME = "/color_bar_shm_latency";
+
+double percentile_us(const std::vector<uint64_t> &sorted_ns, const double p)
+{
+    if (sorted_ns.empty())
+    {
+        return 0.0;
+    }
+    const size_t index = std::min(sorted_ns.size() - 1, static_cast<size_t>(p * sorted_ns.size()));
+    return sorted_ns[index] / 1E3;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    const bool wire_format = argc > 1 && std::string(argv[1]) == "wire";
+    const size_t led_count = argc > 2 ? std::stoul(argv[2]) : 1000;
+    const size_t frame_count = argc > 3 ? std::stoul(argv[3]) : 5000;
+    const double frame_rate_hz = argc > 4 ? std::stod(argv[4]) : 1000.0;
+
+    auto transport = std::make_shared<serial::NullTransport>();
+    serial::SerialConnection serial(transport);
+    const double clock_hz = serial.configure_spi_defaults(NeopixelComms::best_spi_clock_hz());
+    NeopixelComms comms(clock_hz);
+
+    //
+    // The producer has its own encoder, like a separate process would
+    //
+    NeopixelComms producer_comms(clock_hz);
+    const size_t slot_capacity = wire_format ? producer_comms.frame_wire_time_ns(led_count) * clock_hz / 8E9 + 64
+                                             : led_count * sizeof(animations::Color);
+    ShmFrameWriter writer(CHANNEL_NAME, wire_format ? shm::Format::WIRE : shm::Format::PIXELS, slot_capacity);
+    ShmFrameReader reader(CHANNEL_NAME);
+    if (writer.is_open() == false || reader.is_open() == false)
+    {
+        return 1;
+    }
+
+    std::atomic<bool> producing(true);
+    std::thread producer(
+        [&]
+        {
+            animations::Frame frame;
+            frame.colors.resize(led_count);
+            serial::ByteVector_t encoded;
+            auto next_frame = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < frame_count; ++i)
+            {
+                std::fill(frame.colors.begin(), frame.colors.end(), animations::Color(i & 0xFF, 0, 0));
+                if (wire_format)
+                {
+                    producer_comms.build_frame_into(frame.colors.data(), frame.colors.size(), encoded);
+                    writer.publish(encoded.data(), encoded.size());
+                }
+                else
+                {
+                    writer.publish(frame.colors.data(), frame.colors.size() * sizeof(animations::Color));
+                }
+
+                next_frame += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1.0 / frame_rate_hz));
+                std::this_thread::sleep_until(next_frame);
+            }
+            producing = false;
+        });
+
+    //
+    // The driver side
+    //
+    std::vector<uint8_t> frame;
+    serial::ByteVector_t encoded;
+    serial::ByteVector_t packet;
+    std::vector<uint64_t> latencies_ns;
+    latencies_ns.reserve(frame_count);
+    ShmFrameInfo info;
+    while (producing || reader.wait_for_frame(0))
+    {
+        if (reader.wait_for_frame(1000) == false || reader.read_latest(frame, info) == false)
+        {
+            continue;
+        }
+
+        if (wire_format)
+        {
+            serial.spi_write_data(frame.data(), frame.size(), packet);
+        }
+        else
+        {
+            comms.build_frame_into(reinterpret_cast<const animations::Color *>(frame.data()),
+                                   frame.size() / sizeof(animations::Color), encoded);
+            serial.spi_write_data(encoded.data(), encoded.size(), packet);
+        }
+        latencies_ns.push_back(serial::now_ns() - info.timestamp_ns);
+    }
+    producer.join();
+
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    std::cout << (wire_format ? "wire" : "pixel") << " format, " << led_count << " LEDs, " << frame_count
+              << " frames at " << frame_rate_hz << "Hz" << std::endl;
+    std::cout << "  read " << latencies_ns.size() << " frames, " << frame_count - latencies_ns.size()
+              << " replaced before they were read" << std::endl;
+    std::cout << "  publish to written: p50 " << percentile_us(latencies_ns, 0.5) << "us, p99 "
+              << percentile_us(latencies_ns, 0.99) << "us, p99.9 " << percentile_us(latencies_ns, 0.999)
+              << "us, max " << percentile_us(latencies_ns, 1.0) << "us" << std::endl;
+    return 0;
+}
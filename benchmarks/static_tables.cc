@@ -0,0 +1,63 @@
+//
+// Checks that the compile time tables in static_animations.hh are exactly what the
+// run time generators and NeopixelComms make, and shows what the run time version
+// costs that the tables don't. The tables are a 144 LED meter with 20 steps (a common
+// 1m strip) encoded at the best clock, so the sizes here are baked in.
+//
+//     static_tables [repeat_count]
+//
+// Exits with 1 if anything doesn't match
+//
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "../color_bar/static_animations.hh"
+
+namespace
+{
+
+constexpr size_t LED_COUNT = 144;
+constexpr size_t STEP_COUNT = 20;
+using Encoding = animations::StaticEncoding<3>;
+
+constexpr auto METER = animations::static_green_percent_bar_ramp<LED_COUNT, STEP_COUNT>(0.0, 1.0);
+constexpr auto METER_WIRE = animations::static_encode_all<Encoding>(METER);
+
+}
+
+int main(int argc, char **argv)
+{
+    const size_t repeat_count = argc > 1 ? std::stoul(argv[1]) : 1000;
+
+    NeopixelComms comms(Encoding::spi_clock_hz);
+    std::vector<animations::Frame> frames;
+    serial::ByteVector_t encoded;
+
+    bool matched = true;
+    uint64_t runtime_ns = 0;
+    for (size_t repeat = 0; repeat < repeat_count; ++repeat)
+    {
+        const uint64_t start_ns = serial::now_ns();
+        animations::green_percent_bar_ramp_into(0.0, 1.0, LED_COUNT, 0, STEP_COUNT, frames);
+        for (size_t i = 0; i < frames.size(); ++i)
+        {
+            comms.build_frame_into(frames[i], encoded);
+            if (repeat == 0)
+            {
+                matched = matched && encoded.size() == METER_WIRE[i].size() &&
+                          std::memcmp(encoded.data(), METER_WIRE[i].data(), encoded.size()) == 0 &&
+                          std::memcmp(frames[i].colors.data(), METER[i].data(), sizeof(METER[i])) == 0;
+            }
+        }
+        runtime_ns += serial::now_ns() - start_ns;
+    }
+
+    std::cout << LED_COUNT << " LEDs, " << STEP_COUNT + 1 << " frames at " << Encoding::spi_clock_hz << "Hz"
+              << std::endl;
+    std::cout << "  tables: " << sizeof(METER) << " bytes of colors, " << sizeof(METER_WIRE)
+              << " bytes encoded" << std::endl;
+    std::cout << "  making them at run time: " << runtime_ns / 1E3 / repeat_count << "us" << std::endl;
+    std::cout << (matched ? "PASSED" : "FAILED") << std::endl;
+    return matched ? 0 : 1;
+}
@@ -1,10 +1,13 @@
+#include <algorithm>
 #include <assert.h>
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <thread>
 
 #include "animations.hh"
 #include "../ftd2xx_driver/serial.hh"
+#include "../ftd2xx_driver/trace.hh"
 
 namespace animations
 {
@@ -12,28 +15,47 @@ namespace animations
 void play_frames(const std::vector<Frame> &frames,
                  const CommunicationBase_ptr comms,
                  const serial::SerialConnection &serial)
+{
+    PlaybackBuffers buffers;
+    play_frames(frames, comms, serial, buffers);
+}
+
+void play_frames(const std::vector<Frame> &frames,
+                 const CommunicationBase_ptr comms,
+                 const serial::SerialConnection &serial,
+                 PlaybackBuffers &buffers)
 {
     for (const Frame &frame : frames)
     {
-        serial.spi_write_data(comms->build_frame(frame));
+        //
+        // The frames were made before this was called, so "generated" here means it's
+        // this frame's turn
+        //
+        serial::trace::ScopedFrame trace_frame;
+        serial::trace::mark(serial::trace::Stage::GENERATED);
+
+        const uint64_t encode_start_ns = serial::now_ns();
+        comms->build_frame_into(frame, buffers.encoded);
+        serial.metrics().record_frame_played((serial::now_ns() - encode_start_ns) / 1000);
 
-        std::chrono::milliseconds duration(frame.hold_time_ms);
-        std::this_thread::sleep_for(duration);
+        serial.spi_write_data(buffers.encoded.data(), buffers.encoded.size(), buffers.packet);
+
+        //
+        // The latch is in the encoded frame, so there's no need to sleep unless the
+        // frame actually wants to be held
+        //
+        if (frame.hold_time_ms > 0)
+        {
+            std::chrono::milliseconds duration(frame.hold_time_ms);
+            std::this_thread::sleep_for(duration);
+        }
     }
 }
 
 Frame green_percent_bar(const double percent, const size_t led_count)
 {
-    assert(percent <= 1.0);
-    const size_t green_pixels = static_cast<size_t>(led_count * percent);
-
     Frame f;
-    f.colors = std::vector<Color>(led_count, RED);
-    for (size_t i = 0; i < green_pixels; ++i)
-    {
-        f.colors[i] = GREEN;
-    }
-
+    green_percent_bar_into(percent, led_count, f);
     return f;
 }
 
@@ -44,20 +66,7 @@ std::vector<Frame> green_percent_bar_ramp(const double percent_start,
                                           const size_t step_count)
 {
     std::vector<animations::Frame> frames;
-    const double step = (percent_end - percent_start) / step_count;
-    double p = percent_start;
-    for (size_t i = 0; i < step_count; ++i)
-    {
-        animations::Frame this_percent = green_percent_bar(p, led_count);
-        this_percent.hold_time_ms = duration_ms / step_count;
-        frames.push_back(this_percent);
-        p += step;
-    }
-
-    animations::Frame last_percent = green_percent_bar(percent_end, led_count);
-    last_percent.hold_time_ms = duration_ms / step_count;
-    frames.push_back(last_percent);
-
+    green_percent_bar_ramp_into(percent_start, percent_end, led_count, duration_ms, step_count, frames);
     return frames;
 }
 
@@ -66,7 +75,91 @@ std::vector<Frame> fade(const Frame &frame_start,
                         const double duration_ms,
                         const size_t step_count)
 {
-    // TODO
-    return {};
+    std::vector<Frame> frames;
+    fade_into(frame_start, frame_end, duration_ms, step_count, frames);
+    return frames;
+}
+
+void green_percent_bar_colors(const double percent, const size_t led_count, Color *colors)
+{
+    assert(percent <= 1.0);
+    const size_t green_pixels = green_pixel_count(percent, led_count);
+
+    std::fill(colors, colors + green_pixels, GREEN);
+    std::fill(colors + green_pixels, colors + led_count, RED);
+}
+
+void fade_colors(const Color *start, const Color *end, const size_t led_count, const double t, Color *colors)
+{
+    for (size_t led = 0; led < led_count; ++led)
+    {
+        const Color &a = start[led];
+        const Color &b = end[led];
+        colors[led] = Color(a.R + std::lround((b.R - a.R) * t),
+                            a.G + std::lround((b.G - a.G) * t),
+                            a.B + std::lround((b.B - a.B) * t),
+                            a.A + std::lround((b.A - a.A) * t));
+    }
+}
+
+void green_percent_bar_into(const double percent, const size_t led_count, Frame &frame)
+{
+    frame.colors.resize(led_count);
+    green_percent_bar_colors(percent, led_count, frame.colors.data());
+    frame.hold_time_ms = 0;
+}
+
+void green_percent_bar_ramp_into(const double percent_start,
+                                 const double percent_end,
+                                 const size_t led_count,
+                                 const unsigned long duration_ms,
+                                 const size_t step_count,
+                                 std::vector<Frame> &frames)
+{
+    const size_t steps = ramp_steps(step_count);
+
+    //
+    // `steps` steps starting at `percent_start` and then `percent_end` on its own
+    //
+    frames.resize(steps + 1);
+    for (size_t i = 0; i <= steps; ++i)
+    {
+        green_percent_bar_into(percent_step(percent_start, percent_end, steps, i), led_count, frames[i]);
+        frames[i].hold_time_ms = duration_ms / steps;
+    }
+}
+
+bool fade_into(const Frame &frame_start,
+               const Frame &frame_end,
+               const double duration_ms,
+               const size_t step_count,
+               std::vector<Frame> &frames)
+{
+    if (frame_start.colors.size() != frame_end.colors.size())
+    {
+        std::cout << "ERROR: can't fade between frames with different LED counts" << std::endl;
+        frames.clear();
+        return false;
+    }
+
+    const size_t led_count = frame_start.colors.size();
+    const size_t steps = ramp_steps(step_count);
+    const unsigned long hold_time_ms = static_cast<unsigned long>(duration_ms / steps);
+
+    //
+    // Same shape as the percent bar ramp, `steps` steps starting at the first
+    // frame and then the last frame on its own
+    //
+    frames.resize(steps + 1);
+    for (size_t i = 0; i <= steps; ++i)
+    {
+        Frame &f = frames[i];
+        f.colors.resize(led_count);
+        f.hold_time_ms = hold_time_ms;
+        fade_colors(frame_start.colors.data(), frame_end.colors.data(), led_count,
+                    static_cast<double>(i) / steps, f.colors.data());
+    }
+
+    return true;
 }
 } // namespace animations
@@ -23,27 +23,27 @@ struct Color
     //
     // Default is black
     //
-    Color() :
+    constexpr Color() :
         R(0), G(0), B(0), A(255)
     {
     }
 
-    Color(const uchar_t R_, const uchar_t G_, const uchar_t B_) :
+    constexpr Color(const uchar_t R_, const uchar_t G_, const uchar_t B_) :
         R(R_), G(G_), B(B_), A(255)
     {
     }
 
-    Color(const uchar_t R_, const uchar_t G_, const uchar_t B_, const uchar_t A_) :
+    constexpr Color(const uchar_t R_, const uchar_t G_, const uchar_t B_, const uchar_t A_) :
         R(R_), G(G_), B(B_), A(A_)
     {
     }
 };
 
-static Color BLACK = Color(0, 0, 0);
-static Color BLUE = Color(0, 0, 20);
-static Color GREEN = Color(0, 20, 0);
-static Color RED = Color(20, 0, 0);
-static Color WHITE = Color(255, 255, 255);
+constexpr Color BLACK = Color(0, 0, 0);
+constexpr Color BLUE = Color(0, 0, 20);
+constexpr Color GREEN = Color(0, 20, 0);
+constexpr Color RED = Color(20, 0, 0);
+constexpr Color WHITE = Color(255, 255, 255);
 
 //
 // Single Frame struct
@@ -67,7 +67,7 @@ struct Frame
     //
     // How long (in milliseconds) should we hold on this frame before going to the next
     //
-    unsigned long hold_time_ms;
+    unsigned long hold_time_ms = 0;
 };
 
 //
@@ -92,6 +92,15 @@ public: // methods ///////////////////////////////////////////////////////////
     // Given a frame, return a ByteVector_t to send over the wire
     //
     virtual std::vector<unsigned char> build_frame(const animations::Frame &f) = 0;
+
+    //
+    // Same thing into a buffer that's kept between frames. The default just calls
+    // build_frame, anything that can encode without allocating should override it
+    //
+    virtual void build_frame_into(const animations::Frame &f, std::vector<unsigned char> &frame_buffer)
+    {
+        frame_buffer = build_frame(f);
+    }
 };
 using CommunicationBase_ptr = std::shared_ptr<CommunicationBase>;
 
@@ -99,12 +108,26 @@ using CommunicationBase_ptr = std::shared_ptr<CommunicationBase>;
 // Functions that help build animations
 //
 
+//
+// Buffers play_frames encodes into. Keeping one of these around between calls means
+// playback doesn't allocate once it's warmed up
+//
+struct PlaybackBuffers
+{
+    std::vector<unsigned char> encoded;
+    std::vector<unsigned char> packet;
+};
+
 //
 // Play a vector of frames using the communication device and serial connection
 //
 void play_frames(const std::vector<Frame> &frames,
                  const std::shared_ptr<CommunicationBase> comms,
                  const serial::SerialConnection &serial);
+void play_frames(const std::vector<Frame> &frames,
+                 const std::shared_ptr<CommunicationBase> comms,
+                 const serial::SerialConnection &serial,
+                 PlaybackBuffers &buffers);
 
 //
 // Builds a frame with some percent of the entire frame being green and the rest
@@ -114,7 +137,8 @@ Frame green_percent_bar(const double percent, const size_t led_count);
 
 //
 // Builds a vector of frames that transitions between two percentages
-// in some number of steps
+// in some number of steps. A `step_count` of 0 is taken as 1, so there's always
+// something to divide the duration by
 //
 std::vector<Frame> green_percent_bar_ramp(const double percent_start,
                                           const double percent_end,
@@ -127,4 +151,60 @@ std::vector<Frame> fade(const Frame &frame_start,
                         const double duration_ms,
                         const size_t step_count = 100);
 
+//
+// The step count the ramps and fades actually use, 0 steps would be a divide by zero
+//
+constexpr size_t ramp_steps(const size_t step_count)
+{
+    return step_count == 0 ? 1 : step_count;
+}
+
+//
+// What goes in a single frame of the above. `percent_step` is the percent bar ramp's
+// `percent` for frame `step`, fade_colors is `t` (0 to 1) of the way from `start` to
+// `end`. Everything that makes these animations goes through them, so frames come out
+// the same however they're made (the compile time ones in static_animations.hh too)
+//
+constexpr double percent_step(const double percent_start,
+                              const double percent_end,
+                              const size_t step_count,
+                              const size_t step)
+{
+    //
+    // The last step lands right on the end instead of wherever the rounding puts it
+    //
+    return step >= step_count ? percent_end : percent_start + (percent_end - percent_start) * step / step_count;
+}
+
+//
+// How many LEDs from the start of the strip are green at `percent`
+//
+constexpr size_t green_pixel_count(const double percent, const size_t led_count)
+{
+    return static_cast<size_t>(led_count * percent);
+}
+
+void green_percent_bar_colors(const double percent, const size_t led_count, Color *colors);
+void fade_colors(const Color *start, const Color *end, const size_t led_count, const double t, Color *colors);
+
+//
+// The _into versions of the above write over frames that are already there instead of
+// making new ones, so generating into the same frames again (or ones that came from a
+// FramePool) doesn't allocate
+//
+void green_percent_bar_into(const double percent, const size_t led_count, Frame &frame);
+
+void green_percent_bar_ramp_into(const double percent_start,
+                                 const double percent_end,
+                                 const size_t led_count,
+                                 const unsigned long duration_ms,
+                                 const size_t step_count,
+                                 std::vector<Frame> &frames);
+
+bool fade_into(const Frame &frame_start,
+               const Frame &frame_end,
+               const double duration_ms,
+               const size_t step_count,
+               std::vector<Frame> &frames);
+
 } // namespace colorama
@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "compositor.hh"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace animations
+{
+
+namespace
+{
+
+//
+// Blending treats colors as 4 packed bytes
+//
+static_assert(sizeof(Color) == 4, "Color needs to be exactly RGBA bytes");
+
+//
+// x / 255 rounded, exact for anything up to 255 * 255
+//
+inline uint32_t div255(const uint32_t x)
+{
+    const uint32_t rounded = x + 128;
+    return (rounded + (rounded >> 8)) >> 8;
+}
+
+//
+// One premultiplied pixel on top of an opaque one. The destination stays opaque for
+// every mode, so its alpha never needs to be touched
+//
+inline void blend_pixel(const BlendMode mode, const uchar_t opacity, const Color source, Color &destination)
+{
+    const uint32_t s[4] = {div255(source.R * opacity), div255(source.G * opacity),
+                           div255(source.B * opacity), div255(source.A * opacity)};
+    uchar_t *d[3] = {&destination.R, &destination.G, &destination.B};
+    const uint32_t transparency = 255 - s[3];
+
+    for (size_t c = 0; c < 3; ++c)
+    {
+        const uint32_t dst = *d[c];
+        uint32_t out = 0;
+        switch (mode)
+        {
+        case BlendMode::NORMAL:
+            out = s[c] + div255(dst * transparency);
+            break;
+        case BlendMode::ADD:
+            out = std::min<uint32_t>(s[c] + dst, 255);
+            break;
+        case BlendMode::MULTIPLY:
+            out = div255(s[c] * dst) + div255(dst * transparency);
+            break;
+        case BlendMode::SCREEN:
+            out = s[c] + dst - div255(s[c] * dst);
+            break;
+        }
+        *d[c] = static_cast<uchar_t>(out);
+    }
+}
+
+#ifdef __SSE2__
+
+//
+// Same as above for 16 bit lanes
+//
+inline __m128i div255(const __m128i x)
+{
+    const __m128i rounded = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(rounded, _mm_srli_epi16(rounded, 8)), 8);
+}
+
+//
+// Copy each pixel's alpha into all four of its lanes
+//
+inline __m128i broadcast_alpha(const __m128i x)
+{
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+//
+// Two pixels widened to 16 bits per channel
+//
+inline __m128i blend_wide(const BlendMode mode, const __m128i opacity, __m128i s, const __m128i d)
+{
+    s = div255(_mm_mullo_epi16(s, opacity));
+    const __m128i transparency = _mm_sub_epi16(_mm_set1_epi16(255), broadcast_alpha(s));
+
+    switch (mode)
+    {
+    case BlendMode::NORMAL:
+        return _mm_add_epi16(s, div255(_mm_mullo_epi16(d, transparency)));
+    case BlendMode::ADD:
+        return _mm_min_epi16(_mm_add_epi16(s, d), _mm_set1_epi16(255));
+    case BlendMode::MULTIPLY:
+        return _mm_add_epi16(div255(_mm_mullo_epi16(s, d)), div255(_mm_mullo_epi16(d, transparency)));
+    case BlendMode::SCREEN:
+        return _mm_sub_epi16(_mm_add_epi16(s, d), div255(_mm_mullo_epi16(s, d)));
+    }
+    return d;
+}
+
+#endif
+
+}
+
+//
+// ### constructor ############################################################
+//
+
+Compositor::Compositor(const size_t led_count_)
+    : led_count(led_count_)
+{
+    output.colors.resize(led_count);
+}
+
+//
+// ### public methods #########################################################
+//
+
+size_t Compositor::add_layer(const BlendMode mode, const uchar_t opacity)
+{
+    Layer layer;
+    layer.mode = mode;
+    layer.opacity = opacity;
+    layer.colors.assign(led_count, Color(0, 0, 0, 0));
+    layer.dirty_begin = 0;
+    layer.dirty_end = 0;
+    layers.push_back(std::move(layer));
+    return layers.size() - 1;
+}
+
+//
+// ############################################################################
+//
+
+void Compositor::set_pixels(const size_t layer, const size_t offset, const Color *colors, const size_t count)
+{
+    if (valid_layer(layer) == false || offset + count > led_count)
+    {
+        std::cout << "ERROR: can't set " << count << " pixels at " << offset << " on layer " << layer << std::endl;
+        return;
+    }
+
+    //
+    // Premultiply on the way in so blending doesn't have to. Only LEDs that really
+    // changed count as dirty, so setting a whole layer to what it already was is free
+    //
+    Layer &l = layers[layer];
+    size_t first_changed = count;
+    size_t last_changed = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Color in = colors[i];
+        const Color premultiplied(div255(in.R * in.A), div255(in.G * in.A), div255(in.B * in.A), in.A);
+
+        Color &current = l.colors[offset + i];
+        if (std::memcmp(&current, &premultiplied, sizeof(Color)) != 0)
+        {
+            current = premultiplied;
+            first_changed = std::min(first_changed, i);
+            last_changed = i;
+        }
+    }
+
+    if (first_changed < count)
+    {
+        mark_dirty(l, offset + first_changed, offset + last_changed + 1);
+    }
+}
+
+//
+// ############################################################################
+//
+
+void Compositor::set_layer(const size_t layer, const std::vector<Color> &colors)
+{
+    set_pixels(layer, 0, colors.data(), std::min(colors.size(), led_count));
+}
+
+//
+// ############################################################################
+//
+
+void Compositor::clear_layer(const size_t layer)
+{
+    if (valid_layer(layer) == false)
+    {
+        return;
+    }
+    Layer &l = layers[layer];
+    std::fill(l.colors.begin(), l.colors.end(), Color(0, 0, 0, 0));
+    mark_dirty(l, 0, led_count);
+}
+
+//
+// ############################################################################
+//
+
+void Compositor::set_blend_mode(const size_t layer, const BlendMode mode)
+{
+    if (valid_layer(layer) == false || layers[layer].mode == mode)
+    {
+        return;
+    }
+    layers[layer].mode = mode;
+    mark_dirty(layers[layer], 0, led_count);
+}
+
+//
+// ############################################################################
+//
+
+void Compositor::set_opacity(const size_t layer, const uchar_t opacity)
+{
+    if (valid_layer(layer) == false || layers[layer].opacity == opacity)
+    {
+        return;
+    }
+    layers[layer].opacity = opacity;
+    mark_dirty(layers[layer], 0, led_count);
+}
+
+//
+// ############################################################################
+//
+
+const Frame &Compositor::composite()
+{
+    size_t begin = led_count;
+    size_t end = 0;
+    for (Layer &layer : layers)
+    {
+        begin = std::min(begin, layer.dirty_begin);
+        end = std::max(end, layer.dirty_end);
+        layer.dirty_begin = 0;
+        layer.dirty_end = 0;
+    }
+
+    if (begin >= end)
+    {
+        return output;
+    }
+
+    //
+    // Start from black and stack every layer, bottom first, over the dirty part
+    //
+    Color *destination = &output.colors[begin];
+    std::fill(destination, destination + (end - begin), Color(0, 0, 0));
+    for (const Layer &layer : layers)
+    {
+        if (layer.opacity == 0)
+        {
+            continue;
+        }
+        blend_span(layer.mode, layer.opacity, &layer.colors[begin], destination, end - begin);
+    }
+
+    return output;
+}
+
+//
+// ############################################################################
+//
+
+size_t Compositor::layer_count() const
+{
+    return layers.size();
+}
+
+//
+// ### private methods ########################################################
+//
+
+void Compositor::mark_dirty(Layer &layer, const size_t begin, const size_t end)
+{
+    if (layer.dirty_begin >= layer.dirty_end)
+    {
+        layer.dirty_begin = begin;
+        layer.dirty_end = end;
+        return;
+    }
+    layer.dirty_begin = std::min(layer.dirty_begin, begin);
+    layer.dirty_end = std::max(layer.dirty_end, end);
+}
+
+//
+// ############################################################################
+//
+
+bool Compositor::valid_layer(const size_t layer) const
+{
+    if (layer >= layers.size())
+    {
+        std::cout << "ERROR: there's no layer " << layer << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//
+// ### functions ##############################################################
+//
+
+void blend_span(const BlendMode mode, const uchar_t opacity, const Color *source, Color *destination,
+                const size_t count)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    //
+    // Four pixels at a time, split into two halves with 16 bits per channel so the
+    // multiplies have room
+    //
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wide_opacity = _mm_set1_epi16(opacity);
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(destination + i));
+
+        const __m128i low = blend_wide(mode, wide_opacity, _mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        const __m128i high = blend_wide(mode, wide_opacity, _mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+        //
+        // The destination is always opaque, so alpha gets set outright instead of
+        // trusting every mode's math to land on exactly 255
+        //
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+        const __m128i packed = _mm_or_si128(_mm_packus_epi16(low, high), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), packed);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        blend_pixel(mode, opacity, source[i], destination[i]);
+    }
+}
+
+} // namespace animations
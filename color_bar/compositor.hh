@@ -0,0 +1,105 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "animations.hh"
+
+namespace animations
+{
+
+//
+// How a layer mixes with everything under it. All of them respect the layer's alpha
+// (and opacity), so a transparent pixel never changes what's under it
+//
+enum class BlendMode
+{
+    NORMAL,   // Paint over the top
+    ADD,      // Add the light together, good for flashes
+    MULTIPLY, // Darken what's under it, good for masks
+    SCREEN    // Lighten what's under it without blowing out like ADD
+};
+
+//
+// Stacks layers of colors (say background ambience, then the percent meter, then an
+// alert flash) into one frame using Color::A. Layers are kept premultiplied so the
+// blending is a handful of multiplies per pixel, and with SSE2 four pixels go at once.
+//
+// Each layer remembers which LEDs changed since the last composite, and only that part
+// of the strip gets recomposited. The dirty part of each layer is one range, so two
+// changes at opposite ends of the strip still mean redoing everything in between
+//
+class Compositor
+{
+public: // constructor ////////////////////////////////////////////////////////
+    Compositor(const size_t led_count_);
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Add a layer on top of the others, every LED starts transparent. Returns the layer
+    // number to use with everything else
+    //
+    size_t add_layer(const BlendMode mode = BlendMode::NORMAL, const uchar_t opacity = 255);
+
+    //
+    // Change `count` LEDs of a layer starting at `offset`, colors aren't premultiplied
+    //
+    void set_pixels(const size_t layer, const size_t offset, const Color *colors, const size_t count);
+
+    //
+    // Replace a whole layer
+    //
+    void set_layer(const size_t layer, const std::vector<Color> &colors);
+
+    //
+    // Make a layer completely transparent
+    //
+    void clear_layer(const size_t layer);
+
+    void set_blend_mode(const size_t layer, const BlendMode mode);
+    void set_opacity(const size_t layer, const uchar_t opacity);
+
+    //
+    // Blend everything that changed, the frame stays valid until the next call
+    //
+    const Frame &composite();
+
+    size_t layer_count() const;
+
+private: // types /////////////////////////////////////////////////////////////
+    struct Layer
+    {
+        BlendMode mode;
+        uchar_t opacity;
+
+        //
+        // Premultiplied colors
+        //
+        std::vector<Color> colors;
+
+        //
+        // LEDs [dirty_begin, dirty_end) changed since the last composite
+        //
+        size_t dirty_begin;
+        size_t dirty_end;
+    };
+
+private: // methods ///////////////////////////////////////////////////////////
+    void mark_dirty(Layer &layer, const size_t begin, const size_t end);
+
+    bool valid_layer(const size_t layer) const;
+
+private: // members ///////////////////////////////////////////////////////////
+    size_t led_count;
+    std::vector<Layer> layers;
+    Frame output;
+};
+
+//
+// Blend `count` premultiplied `source` pixels on top of `destination`, which has to be
+// opaque. Exposed for benchmarks, Compositor is the thing to use
+//
+void blend_span(const BlendMode mode, const uchar_t opacity, const Color *source, Color *destination,
+                const size_t count);
+
+} // namespace animations
@@ -0,0 +1,592 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "dmx_receiver.hh"
+
+namespace
+{
+
+constexpr auto RELAXED = std::memory_order_relaxed;
+
+//
+// Packets read per recvmmsg and the biggest packet we'd ever want. sACN data packets
+// are 638 bytes and Art-Net ones 530, anything past this gets cut off and ignored
+//
+constexpr size_t BATCH_SIZE = 64;
+constexpr size_t MAX_PACKET_SIZE = 1024;
+
+//
+// A big receive buffer covers the time a batch takes to handle, 40 universes at 44Hz
+// is only about 1MB/s but it comes in bursts
+//
+constexpr int RECEIVE_BUFFER_BYTES = 4 * 1024 * 1024;
+
+//
+// Room for the SO_TIMESTAMPNS control message on each packet
+//
+constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(timespec));
+
+constexpr size_t MAX_SLOTS = 512;
+constexpr double DEFAULT_PUBLISH_TIMEOUT_MS = 25.0;
+
+//
+// E1.31 layout, offsets from the start of the packet
+//
+namespace sacn
+{
+constexpr uint8_t ACN_ID[12] = {'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0};
+constexpr size_t ACN_ID_OFFSET = 4;
+constexpr size_t ROOT_VECTOR_OFFSET = 18;
+constexpr uint32_t VECTOR_ROOT_DATA = 0x00000004;
+constexpr uint32_t VECTOR_ROOT_EXTENDED = 0x00000008;
+
+constexpr size_t FRAMING_VECTOR_OFFSET = 40;
+constexpr uint32_t VECTOR_FRAMING_DATA = 0x00000002;
+constexpr uint32_t VECTOR_EXTENDED_SYNC = 0x00000001;
+
+constexpr size_t SYNC_ADDRESS_OFFSET = 109;
+constexpr size_t SEQUENCE_OFFSET = 111;
+constexpr size_t OPTIONS_OFFSET = 112;
+constexpr size_t UNIVERSE_OFFSET = 113;
+constexpr uint8_t OPTION_PREVIEW = 0x80;
+constexpr uint8_t OPTION_TERMINATED = 0x40;
+
+constexpr size_t DMP_VECTOR_OFFSET = 117;
+constexpr uint8_t VECTOR_DMP_SET_PROPERTY = 0x02;
+constexpr size_t PROPERTY_COUNT_OFFSET = 123;
+constexpr size_t START_CODE_OFFSET = 125;
+constexpr size_t DATA_OFFSET = 126;
+
+constexpr size_t SYNC_PACKET_SIZE = 49;
+}
+
+//
+// Art-Net layout
+//
+namespace artnet
+{
+constexpr uint8_t ID[8] = {'A', 'r', 't', '-', 'N', 'e', 't', 0};
+constexpr size_t OPCODE_OFFSET = 8;
+constexpr uint16_t OP_DMX = 0x5000;
+constexpr uint16_t OP_SYNC = 0x5200;
+constexpr size_t SEQUENCE_OFFSET = 12;
+constexpr size_t SUB_UNIVERSE_OFFSET = 14;
+constexpr size_t NET_OFFSET = 15;
+constexpr size_t LENGTH_OFFSET = 16;
+constexpr size_t DATA_OFFSET = 18;
+constexpr size_t SYNC_PACKET_SIZE = 14;
+}
+
+//
+// Network byte order, without caring about alignment
+//
+inline uint16_t read_u16(const uint8_t *p)
+{
+    return (static_cast<uint16_t>(p[0]) << 8) | p[1];
+}
+
+inline uint32_t read_u32(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+uint64_t realtime_ns(const timespec &t)
+{
+    return static_cast<uint64_t>(t.tv_sec) * 1000000000ull + t.tv_nsec;
+}
+
+//
+// When the kernel says `message` came in, moved over to serial::now_ns()'s clock. The
+// kernel stamps packets with the wall clock, so this goes by how long ago that was.
+// Without a time stamp (the socket option didn't take) it's `now_ns`
+//
+uint64_t packet_arrival_ns(msghdr &message, const uint64_t now_ns, const uint64_t wall_now_ns)
+{
+    for (cmsghdr *c = CMSG_FIRSTHDR(&message); c != nullptr; c = CMSG_NXTHDR(&message, c))
+    {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            timespec stamp;
+            std::memcpy(&stamp, CMSG_DATA(c), sizeof(stamp));
+            const uint64_t age_ns = wall_now_ns - std::min(realtime_ns(stamp), wall_now_ns);
+            return now_ns - std::min(age_ns, now_ns);
+        }
+    }
+    return now_ns;
+}
+
+}
+
+constexpr uint16_t DmxReceiver::SACN_PORT;
+constexpr uint16_t DmxReceiver::ARTNET_PORT;
+constexpr size_t DmxReceiver::LEDS_PER_UNIVERSE;
+
+//
+// ### constructor ############################################################
+//
+
+DmxReceiver::DmxReceiver(const Protocol protocol_,
+                         const std::vector<UniverseMapping> &mappings_,
+                         LatestFrameOutput &output_,
+                         const uint16_t port,
+                         const std::string &address)
+    : protocol(protocol_),
+      socket_fd(-1),
+      running(false),
+      output(output_),
+      universe_index(1 << 16, -1),
+      updated_count(0),
+      synchronized(false),
+      first_update_ns(0),
+      publish_timeout_ns(DEFAULT_PUBLISH_TIMEOUT_MS * 1E6),
+      frame(output_.led_count()),
+      buffers(BATCH_SIZE * MAX_PACKET_SIZE),
+      controls(BATCH_SIZE * CONTROL_SIZE),
+      iovecs(BATCH_SIZE),
+      messages(BATCH_SIZE)
+{
+    //
+    // Only keep mappings we can use, a frame is done when all of them have come in
+    //
+    for (const UniverseMapping &m : mappings_)
+    {
+        if (m.first_led + m.led_count > frame.size() || m.first_slot + 3 * m.led_count > MAX_SLOTS ||
+            universe_index[m.universe] >= 0)
+        {
+            std::cout << "ERROR: universe " << m.universe << " doesn't fit or is mapped twice, it won't be used"
+                      << std::endl;
+            continue;
+        }
+        universe_index[m.universe] = static_cast<int32_t>(mappings.size());
+        mappings.push_back(m);
+    }
+    last_sequence.resize(mappings.size(), 0);
+    have_sequence.resize(mappings.size(), 0);
+    updated.resize(mappings.size(), 0);
+
+    for (size_t i = 0; i < BATCH_SIZE; ++i)
+    {
+        iovecs[i].iov_base = &buffers[i * MAX_PACKET_SIZE];
+        iovecs[i].iov_len = MAX_PACKET_SIZE;
+        std::memset(&messages[i], 0, sizeof(mmsghdr));
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_fd < 0)
+    {
+        std::cout << "ERROR: couldn't make a UDP socket" << std::endl;
+        return;
+    }
+
+    const int enable = 1;
+    setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &RECEIVE_BUFFER_BYTES, sizeof(RECEIVE_BUFFER_BYTES));
+
+    //
+    // Have the kernel stamp every packet with when it came in, so the publish latency
+    // includes the time packets sat in the socket waiting for us
+    //
+    setsockopt(socket_fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+
+    sockaddr_in bind_address;
+    std::memset(&bind_address, 0, sizeof(bind_address));
+    bind_address.sin_family = AF_INET;
+    bind_address.sin_port = htons(port != 0 ? port : protocol == Protocol::SACN ? SACN_PORT : ARTNET_PORT);
+    if (inet_pton(AF_INET, address.c_str(), &bind_address.sin_addr) != 1 ||
+        bind(socket_fd, reinterpret_cast<const sockaddr *>(&bind_address), sizeof(bind_address)) != 0)
+    {
+        std::cout << "ERROR: couldn't listen on " << address << ":" << ntohs(bind_address.sin_port) << std::endl;
+        close(socket_fd);
+        socket_fd = -1;
+        return;
+    }
+
+    if (protocol == Protocol::SACN)
+    {
+        join_multicast_groups();
+    }
+}
+
+//
+// ############################################################################
+//
+
+DmxReceiver::~DmxReceiver()
+{
+    if (socket_fd >= 0)
+    {
+        close(socket_fd);
+    }
+}
+
+//
+// ### public methods #########################################################
+//
+
+bool DmxReceiver::is_open() const
+{
+    return socket_fd >= 0;
+}
+
+//
+// ############################################################################
+//
+
+size_t DmxReceiver::receive(const int timeout_ms)
+{
+    if (socket_fd < 0)
+    {
+        return 0;
+    }
+
+    pollfd ready;
+    ready.fd = socket_fd;
+    ready.events = POLLIN;
+    ready.revents = 0;
+    const int poll_result = ::poll(&ready, 1, timeout_ms);
+
+    int received = 0;
+    if (poll_result > 0)
+    {
+        //
+        // recvmmsg shrinks msg_controllen down to what it used, so it gets put back
+        //
+        for (size_t i = 0; i < BATCH_SIZE; ++i)
+        {
+            messages[i].msg_hdr.msg_control = &controls[i * CONTROL_SIZE];
+            messages[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+        }
+        received = recvmmsg(socket_fd, messages.data(), BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    }
+
+    const uint64_t now_ns = serial::now_ns();
+    timespec wall_now;
+    clock_gettime(CLOCK_REALTIME, &wall_now);
+    const uint64_t wall_now_ns = realtime_ns(wall_now);
+    if (received > 0)
+    {
+        counters.packets.fetch_add(received, RELAXED);
+        counters.batches.fetch_add(1, RELAXED);
+        if (static_cast<uint64_t>(received) > counters.largest_batch.load(RELAXED))
+        {
+            counters.largest_batch.store(received, RELAXED);
+        }
+
+        for (int i = 0; i < received; ++i)
+        {
+            handle_packet(&buffers[i * MAX_PACKET_SIZE], messages[i].msg_len,
+                          packet_arrival_ns(messages[i].msg_hdr, now_ns, wall_now_ns));
+        }
+    }
+
+    //
+    // Don't sit on a partial frame forever if the rest of it isn't coming
+    //
+    if (updated_count > 0 && now_ns - first_update_ns >= publish_timeout_ns)
+    {
+        publish();
+    }
+
+    return received > 0 ? received : 0;
+}
+
+//
+// ############################################################################
+//
+
+void DmxReceiver::run()
+{
+    running = true;
+    while (running)
+    {
+        //
+        // Short timeout so stop() and the publish timeout are noticed quickly
+        //
+        receive(5);
+    }
+}
+
+//
+// ############################################################################
+//
+
+void DmxReceiver::stop()
+{
+    running = false;
+}
+
+//
+// ############################################################################
+//
+
+void DmxReceiver::set_publish_timeout_ms(const double timeout_ms)
+{
+    publish_timeout_ns = static_cast<uint64_t>(timeout_ms * 1E6);
+}
+
+//
+// ############################################################################
+//
+
+DmxReceiver::Stats DmxReceiver::stats() const
+{
+    Stats s;
+    s.packets = counters.packets.load(RELAXED);
+    s.batches = counters.batches.load(RELAXED);
+    s.largest_batch = counters.largest_batch.load(RELAXED);
+    s.dmx_packets = counters.dmx_packets.load(RELAXED);
+    s.sync_packets = counters.sync_packets.load(RELAXED);
+    s.ignored_packets = counters.ignored_packets.load(RELAXED);
+    s.out_of_order = counters.out_of_order.load(RELAXED);
+    s.frames_published = counters.frames_published.load(RELAXED);
+    return s;
+}
+
+//
+// ############################################################################
+//
+
+const serial::LatencyHistogram &DmxReceiver::publish_latency() const
+{
+    return latency;
+}
+
+//
+// ### static methods #########################################################
+//
+
+std::vector<DmxReceiver::UniverseMapping> DmxReceiver::contiguous_mapping(const size_t led_count,
+                                                                          const uint16_t first_universe)
+{
+    std::vector<UniverseMapping> result;
+    for (size_t led = 0; led < led_count; led += LEDS_PER_UNIVERSE)
+    {
+        UniverseMapping m;
+        m.universe = static_cast<uint16_t>(first_universe + result.size());
+        m.first_led = led;
+        m.led_count = std::min(LEDS_PER_UNIVERSE, led_count - led);
+        result.push_back(m);
+    }
+    return result;
+}
+
+//
+// ### private methods ########################################################
+//
+
+void DmxReceiver::handle_packet(const uint8_t *data, const size_t size, const uint64_t arrival_ns)
+{
+    if (protocol == Protocol::SACN)
+    {
+        handle_sacn(data, size, arrival_ns);
+    }
+    else
+    {
+        handle_artnet(data, size, arrival_ns);
+    }
+}
+
+//
+// ############################################################################
+//
+
+void DmxReceiver::handle_sacn(const uint8_t *data, const size_t size, const uint64_t arrival_ns)
+{
+    if (size < sacn::SYNC_PACKET_SIZE || std::memcmp(data + sacn::ACN_ID_OFFSET, sacn::ACN_ID, 12) != 0)
+    {
+        counters.ignored_packets.fetch_add(1, RELAXED);
+        return;
+    }
+
+    const uint32_t root_vector = read_u32(data + sacn::ROOT_VECTOR_OFFSET);
+    const uint32_t framing_vector = read_u32(data + sacn::FRAMING_VECTOR_OFFSET);
+
+    if (root_vector == sacn::VECTOR_ROOT_EXTENDED && framing_vector == sacn::VECTOR_EXTENDED_SYNC)
+    {
+        counters.sync_packets.fetch_add(1, RELAXED);
+        synchronized = true;
+        if (updated_count > 0)
+        {
+            publish();
+        }
+        return;
+    }
+
+    if (root_vector != sacn::VECTOR_ROOT_DATA || framing_vector != sacn::VECTOR_FRAMING_DATA ||
+        size <= sacn::DATA_OFFSET || data[sacn::DMP_VECTOR_OFFSET] != sacn::VECTOR_DMP_SET_PROPERTY ||
+        data[sacn::START_CODE_OFFSET] != 0 || (data[sacn::OPTIONS_OFFSET] & sacn::OPTION_PREVIEW) != 0 ||
+        (data[sacn::OPTIONS_OFFSET] & sacn::OPTION_TERMINATED) != 0)
+    {
+        counters.ignored_packets.fetch_add(1, RELAXED);
+        return;
+    }
+
+    //
+    // The property count includes the start code
+    //
+    const size_t property_count = read_u16(data + sacn::PROPERTY_COUNT_OFFSET);
+    const size_t slot_count = std::min(property_count > 0 ? property_count - 1 : 0, size - sacn::DATA_OFFSET);
+
+    if (read_u16(data + sacn::SYNC_ADDRESS_OFFSET) != 0)
+    {
+        synchronized = true;
+    }
+
+    apply_dmx(read_u16(data + sacn::UNIVERSE_OFFSET), data[sacn::SEQUENCE_OFFSET], data + sacn::DATA_OFFSET,
+              slot_count, arrival_ns);
+}
+
+//
+// ############################################################################
+//
+
+void DmxReceiver::handle_artnet(const uint8_t *data, const size_t size, const uint64_t arrival_ns)
+{
+    if (size < artnet::SYNC_PACKET_SIZE || std::memcmp(data, artnet::ID, sizeof(artnet::ID)) != 0)
+    {
+        counters.ignored_packets.fetch_add(1, RELAXED);
+        return;
+    }
+
+    //
+    // Art-Net opcodes are little endian, unlike everything else in the packet
+    //
+    const uint16_t opcode = data[artnet::OPCODE_OFFSET] | (data[artnet::OPCODE_OFFSET + 1] << 8);
+    if (opcode == artnet::OP_SYNC)
+    {
+        counters.sync_packets.fetch_add(1, RELAXED);
+        synchronized = true;
+        if (updated_count > 0)
+        {
+            publish();
+        }
+        return;
+    }
+
+    if (opcode != artnet::OP_DMX || size <= artnet::DATA_OFFSET)
+    {
+        counters.ignored_packets.fetch_add(1, RELAXED);
+        return;
+    }
+
+    const uint16_t universe = ((data[artnet::NET_OFFSET] & 0x7F) << 8) | data[artnet::SUB_UNIVERSE_OFFSET];
+    const size_t slot_count = std::min<size_t>(read_u16(data + artnet::LENGTH_OFFSET), size - artnet::DATA_OFFSET);
+    apply_dmx(universe, data[artnet::SEQUENCE_OFFSET], data + artnet::DATA_OFFSET, slot_count, arrival_ns);
+}
+
+//
+// ############################################################################
+//
+
+void DmxReceiver::apply_dmx(const uint16_t universe, const uint8_t sequence, const uint8_t *slots,
+                            const size_t slot_count, const uint64_t arrival_ns)
+{
+    const int32_t index = universe_index[universe];
+    if (index < 0)
+    {
+        counters.ignored_packets.fetch_add(1, RELAXED);
+        return;
+    }
+
+    //
+    // E1.31's rule for sequence numbers: anything up to 20 behind the last one is a late
+    // packet and gets dropped, further back than that the sender probably restarted.
+    // Art-Net uses 0 to mean it doesn't do sequence numbers
+    //
+    if (have_sequence[index] && (protocol == Protocol::SACN || sequence != 0))
+    {
+        const int8_t difference = static_cast<int8_t>(sequence - last_sequence[index]);
+        if (difference <= 0 && difference > -20)
+        {
+            counters.out_of_order.fetch_add(1, RELAXED);
+            return;
+        }
+    }
+    last_sequence[index] = sequence;
+    have_sequence[index] = 1;
+    counters.dmx_packets.fetch_add(1, RELAXED);
+
+    //
+    // Straight from the packet buffer into the frame, missing slots are left alone
+    //
+    const UniverseMapping &m = mappings[index];
+    const size_t available = slot_count > m.first_slot ? (slot_count - m.first_slot) / 3 : 0;
+    const uint8_t *in = slots + m.first_slot;
+    animations::Color *out = &frame[m.first_led];
+    for (size_t i = 0; i < std::min(available, m.led_count); ++i)
+    {
+        out[i].R = in[0];
+        out[i].G = in[1];
+        out[i].B = in[2];
+        in += 3;
+    }
+
+    if (updated_count == 0)
+    {
+        first_update_ns = arrival_ns;
+    }
+    if (updated[index] == 0)
+    {
+        updated[index] = 1;
+        ++updated_count;
+    }
+
+    if (synchronized == false && updated_count == mappings.size())
+    {
+        publish();
+    }
+}
+
+//
+// ############################################################################
+//
+
+void DmxReceiver::publish()
+{
+    output.publish(frame.data(), frame.size());
+    latency.record((serial::now_ns() - first_update_ns) / 1000);
+    counters.frames_published.fetch_add(1, RELAXED);
+
+    std::fill(updated.begin(), updated.end(), 0);
+    updated_count = 0;
+}
+
+//
+// ############################################################################
+//
+
+void DmxReceiver::join_multicast_groups()
+{
+    //
+    // sACN universe N is sent to 239.255.N/256.N%256. Not every box has a multicast
+    // route (a dev box on localhost usually doesn't), and Linux only lets a socket join
+    // net.ipv4.igmp_max_memberships (20 by default) groups, so this is best effort.
+    // Unicast works either way
+    //
+    size_t failed = 0;
+    for (const UniverseMapping &m : mappings)
+    {
+        ip_mreq request;
+        request.imr_multiaddr.s_addr = htonl((239u << 24) | (255u << 16) | m.universe);
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(socket_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) != 0)
+        {
+            ++failed;
+        }
+    }
+
+    if (failed > 0)
+    {
+        std::cout << "Couldn't join the multicast group for " << failed << " of " << mappings.size()
+                  << " universes, those will only work over unicast" << std::endl;
+    }
+}
@@ -0,0 +1,193 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+#include "animations.hh"
+#include "frame_output.hh"
+#include "../ftd2xx_driver/metrics.hh"
+
+//
+// Listens for DMX over the network, either E1.31 (sACN) or Art-Net, and turns the
+// universes into frames for a LatestFrameOutput. Each universe is mapped onto a range
+// of LEDs with 3 DMX slots (R, G, B) per LED, so a full universe is 170 LEDs.
+//
+// Packets are read in batches with recvmmsg into buffers that are allocated once, and
+// parsed right where they landed. The only copy is the DMX data going into the frame.
+//
+// A frame is published as soon as every mapped universe has come in since the last
+// one. If the sender uses sync packets (sACN synchronization or ArtSync) frames are
+// published on the sync instead. Senders that only send the universes that changed
+// still get their frames out after `publish_timeout_ms`.
+//
+// Everything but stats() and stop() should be called from one thread
+//
+class DmxReceiver
+{
+public: // types //////////////////////////////////////////////////////////////
+    enum class Protocol
+    {
+        SACN,
+        ARTNET
+    };
+
+    //
+    // DMX slots starting at `first_slot` (0 based) of `universe` go to `led_count` LEDs
+    // starting at `first_led`
+    //
+    struct UniverseMapping
+    {
+        uint16_t universe = 0;
+        size_t first_led = 0;
+        size_t led_count = 0;
+        size_t first_slot = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t packets = 0;
+        uint64_t batches = 0;
+        uint64_t largest_batch = 0;
+        uint64_t dmx_packets = 0;
+        uint64_t sync_packets = 0;
+
+        //
+        // Not something we understand, preview data, or a universe nobody mapped
+        //
+        uint64_t ignored_packets = 0;
+
+        //
+        // Packets that came in behind a newer one for the same universe and were dropped
+        //
+        uint64_t out_of_order = 0;
+
+        uint64_t frames_published = 0;
+    };
+
+public: // constants //////////////////////////////////////////////////////////
+    static constexpr uint16_t SACN_PORT = 5568;
+    static constexpr uint16_t ARTNET_PORT = 6454;
+    static constexpr size_t LEDS_PER_UNIVERSE = 170;
+
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // Opens the socket right away, check is_open(). A `port` of 0 means the standard
+    // port for the protocol
+    //
+    DmxReceiver(const Protocol protocol_,
+                const std::vector<UniverseMapping> &mappings_,
+                LatestFrameOutput &output_,
+                const uint16_t port = 0,
+                const std::string &address = "0.0.0.0");
+
+    ~DmxReceiver();
+
+public: // methods ////////////////////////////////////////////////////////////
+    bool is_open() const;
+
+    //
+    // Wait up to `timeout_ms` for packets and handle one batch of them. Returns how many
+    // packets came in
+    //
+    size_t receive(const int timeout_ms);
+
+    //
+    // Keep receiving until stop() is called (from any thread)
+    //
+    void run();
+    void stop();
+
+    //
+    // Publish partial frames when nothing new has finished a frame in this long
+    //
+    void set_publish_timeout_ms(const double timeout_ms);
+
+    Stats stats() const;
+
+    //
+    // Time from the first packet of a frame coming in to that frame being published. The
+    // start is the kernel's receive time stamp for the packet, so time spent sitting in
+    // the socket before we got around to reading it counts too
+    //
+    const serial::LatencyHistogram &publish_latency() const;
+
+public: // static methods /////////////////////////////////////////////////////
+    //
+    // Lay `led_count` LEDs across as many universes as it takes starting at
+    // `first_universe`, 170 LEDs in each
+    //
+    static std::vector<UniverseMapping> contiguous_mapping(const size_t led_count, const uint16_t first_universe = 1);
+
+private: // methods ///////////////////////////////////////////////////////////
+    void handle_packet(const uint8_t *data, const size_t size, const uint64_t arrival_ns);
+    void handle_sacn(const uint8_t *data, const size_t size, const uint64_t arrival_ns);
+    void handle_artnet(const uint8_t *data, const size_t size, const uint64_t arrival_ns);
+
+    //
+    // Copy a universe's slots into the frame, and publish if that finished it
+    //
+    void apply_dmx(const uint16_t universe, const uint8_t sequence, const uint8_t *slots, const size_t slot_count,
+                   const uint64_t arrival_ns);
+
+    void publish();
+
+    //
+    // Join the multicast group for each sACN universe
+    //
+    void join_multicast_groups();
+
+private: // members ///////////////////////////////////////////////////////////
+    Protocol protocol;
+    int socket_fd;
+    std::atomic<bool> running;
+
+    std::vector<UniverseMapping> mappings;
+    LatestFrameOutput &output;
+
+    //
+    // Universe number straight to its index in `mappings`, -1 if it isn't mapped
+    //
+    std::vector<int32_t> universe_index;
+
+    //
+    // Per mapping: the last sequence number (and if there's been one) and if it's come
+    // in since the last publish
+    //
+    std::vector<uint8_t> last_sequence;
+    std::vector<uint8_t> have_sequence;
+    std::vector<uint8_t> updated;
+    size_t updated_count;
+
+    //
+    // Set once the sender has shown it sends sync packets
+    //
+    bool synchronized;
+    uint64_t first_update_ns;
+    uint64_t publish_timeout_ns;
+
+    std::vector<animations::Color> frame;
+
+    //
+    // recvmmsg buffers, and room for each packet's receive time stamp
+    //
+    std::vector<uint8_t> buffers;
+    std::vector<uint8_t> controls;
+    std::vector<iovec> iovecs;
+    std::vector<mmsghdr> messages;
+
+    struct AtomicStats
+    {
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> largest_batch{0};
+        std::atomic<uint64_t> dmx_packets{0};
+        std::atomic<uint64_t> sync_packets{0};
+        std::atomic<uint64_t> ignored_packets{0};
+        std::atomic<uint64_t> out_of_order{0};
+        std::atomic<uint64_t> frames_published{0};
+    };
+    AtomicStats counters;
+    serial::LatencyHistogram latency;
+};
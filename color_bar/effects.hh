@@ -0,0 +1,275 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <stddef.h>
+
+#include "animations.hh"
+
+//
+// Per pixel effects that compose without making any frames in between. Something like
+//
+//     render(gradient(BLUE, WHITE) * pulse(t) + solid(RED) * mask(0, 10), frame);
+//
+// builds a little tree of types at compile time, and `render` walks the LEDs once
+// asking the tree for each one. Every operator gets inlined into that one loop, so
+// stacking more effects costs some math per LED but no more passes over memory.
+//
+// Everything works in floats from 0 to 1 and only gets clamped and turned back into
+// bytes at the very end, so adding two bright things together doesn't wrap
+//
+namespace animations
+{
+namespace effects
+{
+
+//
+// One LED's worth of light while an effect is being worked out
+//
+struct Rgb
+{
+    float r;
+    float g;
+    float b;
+};
+
+inline Rgb operator*(const Rgb &lhs, const Rgb &rhs)
+{
+    return {lhs.r * rhs.r, lhs.g * rhs.g, lhs.b * rhs.b};
+}
+
+inline Rgb operator+(const Rgb &lhs, const Rgb &rhs)
+{
+    return {lhs.r + rhs.r, lhs.g + rhs.g, lhs.b + rhs.b};
+}
+
+inline Rgb to_rgb(const Color &c)
+{
+    return {c.R / 255.0f, c.G / 255.0f, c.B / 255.0f};
+}
+
+inline uchar_t to_byte(const float value)
+{
+    return static_cast<uchar_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+//
+// Everything that can go in an expression derives from this, it's just here so the
+// operators below only pick up effects and not every type in the world. `Derived`
+// needs a `Rgb operator()(size_t led, size_t led_count) const`
+//
+template <typename Derived>
+struct Effect
+{
+    const Derived &self() const
+    {
+        return static_cast<const Derived &>(*this);
+    }
+};
+
+//
+// ### leaves #################################################################
+//
+
+//
+// The same color everywhere
+//
+struct Solid : Effect<Solid>
+{
+    Rgb color;
+
+    Rgb operator()(size_t, size_t) const
+    {
+        return color;
+    }
+};
+
+inline Solid solid(const Color &color)
+{
+    Solid s;
+    s.color = to_rgb(color);
+    return s;
+}
+
+//
+// The same brightness everywhere, this is what plain numbers turn into
+//
+inline Solid constant(const float value)
+{
+    Solid s;
+    s.color = {value, value, value};
+    return s;
+}
+
+//
+// Blend from `from` at the first LED to `to` at the last
+//
+struct Gradient : Effect<Gradient>
+{
+    Rgb from;
+    Rgb to;
+
+    Rgb operator()(const size_t led, const size_t led_count) const
+    {
+        const float t = led_count > 1 ? static_cast<float>(led) / (led_count - 1) : 0.0f;
+        return {from.r + (to.r - from.r) * t, from.g + (to.g - from.g) * t, from.b + (to.b - from.b) * t};
+    }
+};
+
+inline Gradient gradient(const Color &from, const Color &to)
+{
+    Gradient g;
+    g.from = to_rgb(from);
+    g.to = to_rgb(to);
+    return g;
+}
+
+//
+// Breathing brightness for time `time_s`, going from `minimum` up to 1 and back once
+// every `period_s`. It's the same for every LED so it only gets worked out once
+//
+inline Solid pulse(const double time_s, const double period_s = 1.0, const float minimum = 0.0f)
+{
+    const double phase = 0.5 - 0.5 * std::cos(2.0 * M_PI * time_s / period_s);
+    return constant(minimum + (1.0f - minimum) * static_cast<float>(phase));
+}
+
+//
+// 1 for LEDs in [begin, end) and 0 everywhere else
+//
+struct Mask : Effect<Mask>
+{
+    size_t begin;
+    size_t end;
+
+    Rgb operator()(const size_t led, size_t) const
+    {
+        const float inside = led >= begin && led < end ? 1.0f : 0.0f;
+        return {inside, inside, inside};
+    }
+};
+
+inline Mask mask(const size_t begin, const size_t end)
+{
+    Mask m;
+    m.begin = begin;
+    m.end = end;
+    return m;
+}
+
+//
+// Same as a mask over the first `percent` (0 to 1) of the strip, whatever length it is
+//
+struct PercentMask : Effect<PercentMask>
+{
+    double percent;
+
+    Rgb operator()(const size_t led, const size_t led_count) const
+    {
+        const float inside = led < static_cast<size_t>(led_count * percent) ? 1.0f : 0.0f;
+        return {inside, inside, inside};
+    }
+};
+
+inline PercentMask percent_mask(const double percent)
+{
+    PercentMask m;
+    m.percent = percent;
+    return m;
+}
+
+//
+// ### operators ##############################################################
+//
+
+//
+// Children are held by value, they're all tiny and it means an expression can be
+// built out of temporaries and kept around
+//
+template <typename Lhs, typename Rhs>
+struct Product : Effect<Product<Lhs, Rhs>>
+{
+    Lhs lhs;
+    Rhs rhs;
+
+    Product(const Lhs &lhs_, const Rhs &rhs_) : lhs(lhs_), rhs(rhs_)
+    {
+    }
+
+    Rgb operator()(const size_t led, const size_t led_count) const
+    {
+        return lhs(led, led_count) * rhs(led, led_count);
+    }
+};
+
+template <typename Lhs, typename Rhs>
+struct Sum : Effect<Sum<Lhs, Rhs>>
+{
+    Lhs lhs;
+    Rhs rhs;
+
+    Sum(const Lhs &lhs_, const Rhs &rhs_) : lhs(lhs_), rhs(rhs_)
+    {
+    }
+
+    Rgb operator()(const size_t led, const size_t led_count) const
+    {
+        return lhs(led, led_count) + rhs(led, led_count);
+    }
+};
+
+template <typename Lhs, typename Rhs>
+Product<Lhs, Rhs> operator*(const Effect<Lhs> &lhs, const Effect<Rhs> &rhs)
+{
+    return Product<Lhs, Rhs>(lhs.self(), rhs.self());
+}
+
+template <typename Lhs, typename Rhs>
+Sum<Lhs, Rhs> operator+(const Effect<Lhs> &lhs, const Effect<Rhs> &rhs)
+{
+    return Sum<Lhs, Rhs>(lhs.self(), rhs.self());
+}
+
+//
+// Scaling by a plain number, like `0.5f * solid(WHITE)`
+//
+template <typename E>
+Product<Solid, E> operator*(const float scale, const Effect<E> &effect)
+{
+    return Product<Solid, E>(constant(scale), effect.self());
+}
+
+template <typename E>
+Product<E, Solid> operator*(const Effect<E> &effect, const float scale)
+{
+    return Product<E, Solid>(effect.self(), constant(scale));
+}
+
+//
+// ### rendering ##############################################################
+//
+
+//
+// Work out `led_count` LEDs of an effect straight into `colors`
+//
+template <typename E>
+void render(const Effect<E> &effect, Color *colors, const size_t led_count)
+{
+    const E &e = effect.self();
+    for (size_t i = 0; i < led_count; ++i)
+    {
+        const Rgb rgb = e(i, led_count);
+        colors[i] = Color(to_byte(rgb.r), to_byte(rgb.g), to_byte(rgb.b));
+    }
+}
+
+//
+// Fill every LED already in the frame, so size it first
+//
+template <typename E>
+void render(const Effect<E> &effect, Frame &frame)
+{
+    render(effect, frame.colors.data(), frame.colors.size());
+}
+
+} // namespace effects
+} // namespace animations
@@ -0,0 +1,132 @@
+#include <algorithm>
+
+#include "frame_output.hh"
+#include "../ftd2xx_driver/trace.hh"
+
+namespace
+{
+constexpr auto RELAXED = std::memory_order_relaxed;
+}
+
+//
+// ### constructor ############################################################
+//
+
+LatestFrameOutput::LatestFrameOutput(const serial::SerialConnection &serial_, NeopixelComms &comms_,
+                                     const size_t led_count_)
+    : serial(serial_),
+      comms(comms_),
+      leds(led_count_),
+      pending(led_count_),
+      sending(led_count_),
+      pending_trace_frame(0),
+      sending_trace_frame(0),
+      have_pending(false),
+      stopping(false),
+      frames_published(0),
+      frames_written(0),
+      frames_skipped(0),
+      write_errors(0)
+{
+    thread = std::thread(&LatestFrameOutput::run, this);
+}
+
+//
+// ############################################################################
+//
+
+LatestFrameOutput::~LatestFrameOutput()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frame_ready.notify_one();
+    thread.join();
+}
+
+//
+// ### public methods #########################################################
+//
+
+void LatestFrameOutput::publish(const animations::Color *colors, const size_t count)
+{
+    serial::trace::ScopedFrame trace_frame;
+    serial::trace::mark(serial::trace::Stage::GENERATED);
+
+    const size_t used = std::min(count, leds);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::copy(colors, colors + used, pending.begin());
+        std::fill(pending.begin() + used, pending.end(), animations::Color());
+        pending_trace_frame = serial::trace::current_frame();
+
+        if (have_pending)
+        {
+            frames_skipped.fetch_add(1, RELAXED);
+        }
+        have_pending = true;
+        serial::trace::mark(serial::trace::Stage::ENQUEUED);
+    }
+    frames_published.fetch_add(1, RELAXED);
+    frame_ready.notify_one();
+}
+
+//
+// ############################################################################
+//
+
+LatestFrameOutput::Stats LatestFrameOutput::stats() const
+{
+    Stats s;
+    s.frames_published = frames_published.load(RELAXED);
+    s.frames_written = frames_written.load(RELAXED);
+    s.frames_skipped = frames_skipped.load(RELAXED);
+    s.write_errors = write_errors.load(RELAXED);
+    return s;
+}
+
+//
+// ############################################################################
+//
+
+size_t LatestFrameOutput::led_count() const
+{
+    return leds;
+}
+
+//
+// ### private methods ########################################################
+//
+
+void LatestFrameOutput::run()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            frame_ready.wait(lock, [this] { return stopping || have_pending; });
+            if (stopping)
+            {
+                return;
+            }
+            sending.swap(pending);
+            sending_trace_frame = pending_trace_frame;
+            have_pending = false;
+        }
+
+        //
+        // Encoding and writing happen without the lock so publishers never wait on USB
+        //
+        serial::trace::ScopedFrame trace_frame(sending_trace_frame);
+        comms.build_frame_into(sending.data(), sending.size(), encoded);
+        if (serial.spi_write_data(encoded.data(), encoded.size(), packet))
+        {
+            frames_written.fetch_add(1, RELAXED);
+        }
+        else
+        {
+            write_errors.fetch_add(1, RELAXED);
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "animations.hh"
+#include "neopixel_comms.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+//
+// Sends whatever the newest frame is out to the strip on its own thread. Network inputs
+// publish frames as fast as they come in, and if the strip can't keep up the frames in
+// between just get skipped instead of piling up, so the strip is never showing
+// something old.
+//
+// The connection and encoder have to outlive this, and nothing else should be writing
+// through them while it's running
+//
+class LatestFrameOutput
+{
+public: // types //////////////////////////////////////////////////////////////
+    struct Stats
+    {
+        uint64_t frames_published = 0;
+        uint64_t frames_written = 0;
+
+        //
+        // Published but replaced by a newer frame before it went out
+        //
+        uint64_t frames_skipped = 0;
+        uint64_t write_errors = 0;
+    };
+
+public: // constructor ////////////////////////////////////////////////////////
+    LatestFrameOutput(const serial::SerialConnection &serial_, NeopixelComms &comms_, const size_t led_count_);
+
+    //
+    // Waits for the frame being written (if there is one) and stops
+    //
+    ~LatestFrameOutput();
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Copy a frame in to be sent next. Anything past `led_count` is ignored and anything
+    // short of it is left black
+    //
+    void publish(const animations::Color *colors, const size_t count);
+
+    Stats stats() const;
+
+    size_t led_count() const;
+
+private: // methods ///////////////////////////////////////////////////////////
+    void run();
+
+private: // members ///////////////////////////////////////////////////////////
+    const serial::SerialConnection &serial;
+    NeopixelComms &comms;
+    size_t leds;
+
+    //
+    // Publishers fill `pending`, the thread swaps it with `sending` when it's ready for
+    // another frame. Swapping keeps both buffers allocated
+    //
+    std::mutex mutex;
+    std::condition_variable frame_ready;
+    std::vector<animations::Color> pending;
+    std::vector<animations::Color> sending;
+
+    //
+    // Which frame each buffer holds for tracing (see serial::trace), 0 when it's off
+    //
+    uint64_t pending_trace_frame;
+    uint64_t sending_trace_frame;
+    bool have_pending;
+    bool stopping;
+
+    serial::ByteVector_t encoded;
+    serial::ByteVector_t packet;
+
+    std::atomic<uint64_t> frames_published;
+    std::atomic<uint64_t> frames_written;
+    std::atomic<uint64_t> frames_skipped;
+    std::atomic<uint64_t> write_errors;
+
+    std::thread thread;
+};
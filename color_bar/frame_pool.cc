@@ -0,0 +1,91 @@
+#include "frame_pool.hh"
+
+namespace animations
+{
+
+//
+// ### constructor ############################################################
+//
+
+FramePool::FramePool(const size_t led_count_, const size_t preallocate)
+    : leds(led_count_)
+{
+    free_frames.reserve(preallocate);
+    for (size_t i = 0; i < preallocate; ++i)
+    {
+        Frame frame;
+        frame.colors.resize(leds);
+        free_frames.push_back(std::move(frame));
+    }
+}
+
+//
+// ### public methods #########################################################
+//
+
+Frame FramePool::acquire()
+{
+    Frame frame;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (free_frames.empty() == false)
+        {
+            frame = std::move(free_frames.back());
+            free_frames.pop_back();
+        }
+    }
+
+    //
+    // A no-op for anything that came out of the pool
+    //
+    frame.colors.resize(leds);
+    frame.hold_time_ms = 0;
+    return frame;
+}
+
+//
+// ############################################################################
+//
+
+void FramePool::release(Frame &&frame)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    free_frames.push_back(std::move(frame));
+}
+
+//
+// ############################################################################
+//
+
+void FramePool::release(std::vector<Frame> &frames)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        for (Frame &frame : frames)
+        {
+            free_frames.push_back(std::move(frame));
+        }
+    }
+    frames.clear();
+}
+
+//
+// ############################################################################
+//
+
+size_t FramePool::available() const
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    return free_frames.size();
+}
+
+//
+// ############################################################################
+//
+
+size_t FramePool::led_count() const
+{
+    return leds;
+}
+
+} // namespace animations
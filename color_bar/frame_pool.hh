@@ -0,0 +1,56 @@
+#pragma once
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+
+#include "animations.hh"
+
+namespace animations
+{
+
+//
+// Keeps Frames that aren't being used any more so their colors can be reused instead
+// of allocating new ones. Once the pool has seen as many frames as are ever out at the
+// same time, acquiring and releasing doesn't allocate at all.
+//
+// Safe to acquire from one thread and release from another
+//
+class FramePool
+{
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // Frames from the pool have `led_count_` colors, `preallocate` of them are made up
+    // front
+    //
+    FramePool(const size_t led_count_, const size_t preallocate = 0);
+
+    FramePool(const FramePool &p) = delete;
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // A frame with `led_count()` colors in it. They're whatever the last user left
+    // behind, so write every one of them. Only allocates if the pool is empty
+    //
+    Frame acquire();
+
+    //
+    // Give a frame (or all of them) back, `frames` is left empty
+    //
+    void release(Frame &&frame);
+    void release(std::vector<Frame> &frames);
+
+    //
+    // Frames sitting in the pool right now
+    //
+    size_t available() const;
+
+    size_t led_count() const;
+
+private: // members ///////////////////////////////////////////////////////////
+    size_t leds;
+
+    mutable std::mutex pool_mutex;
+    std::vector<Frame> free_frames;
+};
+
+} // namespace animations
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <iostream>
+
+#include "frame_sequence.hh"
+
+namespace animations
+{
+
+//
+// ### constructor ############################################################
+//
+
+FrameSequence::FrameSequence(const size_t led_count_)
+    : leds(led_count_)
+{
+}
+
+//
+// ############################################################################
+//
+
+FrameSequence FrameSequence::from_frames(const std::vector<Frame> &frames)
+{
+    FrameSequence sequence(frames.empty() ? 0 : frames.front().colors.size());
+    sequence.colors.reserve(frames.size() * sequence.leds);
+    sequence.hold_times.reserve(frames.size());
+    for (const Frame &frame : frames)
+    {
+        sequence.push_back(frame);
+    }
+    return sequence;
+}
+
+//
+// ### public methods #########################################################
+//
+
+void FrameSequence::push_back(const Frame &frame)
+{
+    if (frame.colors.size() != leds)
+    {
+        std::cout << "ERROR: frame has " << frame.colors.size() << " LEDs, sequence has " << leds << std::endl;
+    }
+
+    const size_t count = std::min(frame.colors.size(), leds);
+    colors.insert(colors.end(), frame.colors.begin(), frame.colors.begin() + count);
+    colors.resize(colors.size() + leds - count);
+    hold_times.push_back(frame.hold_time_ms);
+}
+
+//
+// ############################################################################
+//
+
+void FrameSequence::resize(const size_t frame_count)
+{
+    colors.resize(frame_count * leds);
+    hold_times.resize(frame_count);
+}
+
+//
+// ############################################################################
+//
+
+Frame FrameSequence::frame(const size_t index) const
+{
+    Frame f;
+    if (index >= hold_times.size())
+    {
+        std::cout << "ERROR: there's no frame " << index << std::endl;
+        return f;
+    }
+
+    const auto begin = colors.begin() + index * leds;
+    f.colors.assign(begin, begin + leds);
+    f.hold_time_ms = hold_times[index];
+    return f;
+}
+
+//
+// ############################################################################
+//
+
+size_t FrameSequence::frame_count() const
+{
+    return hold_times.size();
+}
+
+//
+// ############################################################################
+//
+
+size_t FrameSequence::led_count() const
+{
+    return leds;
+}
+
+//
+// ############################################################################
+//
+
+Color *FrameSequence::data()
+{
+    return colors.data();
+}
+
+//
+// ############################################################################
+//
+
+const Color *FrameSequence::data() const
+{
+    return colors.data();
+}
+
+//
+// ############################################################################
+//
+
+Color *FrameSequence::frame_data(const size_t index)
+{
+    return colors.data() + index * leds;
+}
+
+//
+// ############################################################################
+//
+
+const std::vector<unsigned long> &FrameSequence::hold_times_ms() const
+{
+    return hold_times;
+}
+
+//
+// ############################################################################
+//
+
+void FrameSequence::set_hold_time_ms(const size_t index, const unsigned long hold_time_ms)
+{
+    hold_times[index] = hold_time_ms;
+}
+
+} // namespace animations
@@ -0,0 +1,69 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+#include "animations.hh"
+
+namespace animations
+{
+
+//
+// A whole animation in one block of memory, frame after frame with every LED as RGBA
+// bytes. Unlike a std::vector<Frame> this can be handed to numpy as it is, so Python
+// tooling can look at a long show without making a Python object per pixel
+//
+class FrameSequence
+{
+public: // constructor ////////////////////////////////////////////////////////
+    FrameSequence(const size_t led_count_ = 0);
+
+    //
+    // Copy some frames in, they should all be the same length
+    //
+    static FrameSequence from_frames(const std::vector<Frame> &frames);
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Add a frame at the end, shorter frames get padded with black and longer ones
+    // get cut off
+    //
+    void push_back(const Frame &frame);
+
+    //
+    // Make room for exactly `frame_count` frames, new ones are black. Filling in a
+    // sequence that's already the right size is how frames get made in parallel
+    //
+    void resize(const size_t frame_count);
+
+    //
+    // Copy a single frame back out
+    //
+    Frame frame(const size_t index) const;
+
+    size_t frame_count() const;
+    size_t led_count() const;
+
+    //
+    // Start of the colors, `frame_count() * led_count()` of them
+    //
+    Color *data();
+    const Color *data() const;
+
+    //
+    // Start of frame `index`'s colors
+    //
+    Color *frame_data(const size_t index);
+
+    //
+    // How long each frame wants to be held for
+    //
+    const std::vector<unsigned long> &hold_times_ms() const;
+    void set_hold_time_ms(const size_t index, const unsigned long hold_time_ms);
+
+private: // members ///////////////////////////////////////////////////////////
+    size_t leds;
+    std::vector<Color> colors;
+    std::vector<unsigned long> hold_times;
+};
+
+} // namespace animations
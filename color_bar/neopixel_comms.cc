@@ -0,0 +1,486 @@
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "neopixel_comms.hh"
+#include "../ftd2xx_driver/trace.hh"
+
+using namespace neopixel_timing;
+
+namespace
+{
+
+//
+// Brightness steps, and fixed point scale of the corrected values
+//
+constexpr uint32_t FULL_BRIGHTNESS = 256;
+constexpr double CORRECTED_SCALE = 256.0;
+
+//
+// Rough RGB of a blackbody at `kelvin`, each channel 0 to 255. This is the curve fit
+// from Tanner Helland's write up, it's only meant to be good enough for lighting
+//
+std::array<double, 3> blackbody_rgb(const double kelvin)
+{
+    const double t = std::min(std::max(kelvin, 1000.0), 40000.0) / 100.0;
+
+    const double red = t <= 66.0 ? 255.0 : 329.698727446 * std::pow(t - 60.0, -0.1332047592);
+    const double green = t <= 66.0 ? 99.4708025861 * std::log(t) - 161.1195681661
+                                   : 288.1221695283 * std::pow(t - 60.0, -0.0755148492);
+    const double blue = t >= 66.0 ? 255.0 : t <= 19.0 ? 0.0 : 138.5177312231 * std::log(t - 10.0) - 305.0447927307;
+
+    return {std::min(std::max(red, 0.0), 255.0),
+            std::min(std::max(green, 0.0), 255.0),
+            std::min(std::max(blue, 0.0), 255.0)};
+}
+
+//
+// How much to scale each channel so white looks like `kelvin` instead of 6500K. The
+// brightest channel stays at 1 so nothing gets clipped
+//
+std::array<double, 3> color_temperature_scale(const double kelvin)
+{
+    const std::array<double, 3> target = blackbody_rgb(kelvin);
+    const std::array<double, 3> reference = blackbody_rgb(6500.0);
+
+    std::array<double, 3> scale;
+    for (size_t c = 0; c < 3; ++c)
+    {
+        scale[c] = target[c] / reference[c];
+    }
+
+    const double largest = *std::max_element(scale.begin(), scale.end());
+    for (double &s : scale)
+    {
+        s /= largest;
+    }
+    return scale;
+}
+
+}
+
+//
+// ### constructor ############################################################
+//
+
+NeopixelComms::NeopixelComms(const double spi_clock_hz, const double latch_time_us)
+    : latch_byte_count(0),
+      channel_sums{{0, 0, 0}},
+      current_estimate_ma(0.0),
+      brightness_level(FULL_BRIGHTNESS)
+{
+    if (compute_timing(spi_clock_hz, symbol_timing) == false)
+    {
+        std::cout << "Can't make Neopixel timing with a " << spi_clock_hz << "Hz SPI clock" << std::endl;
+        assert(false);
+        return;
+    }
+
+    latch_byte_count = latch_bytes_for(latch_time_us, spi_clock_hz);
+
+    byte_table.resize(256 * symbol_timing.symbol_bits);
+    for (size_t byte = 0; byte < 256; ++byte)
+    {
+        convert_byte_to_spi(static_cast<BYTE>(byte), &byte_table[byte * symbol_timing.symbol_bits]);
+    }
+
+    build_correction();
+    build_channel_tables();
+}
+
+//
+// ### public methods #########################################################
+//
+
+serial::ByteVector_t NeopixelComms::build_frame(const animations::Frame &f)
+{
+    serial::ByteVector_t frame_buffer;
+    build_frame_into(f.colors.data(), f.colors.size(), frame_buffer);
+    return frame_buffer;
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelComms::build_frame_into(const animations::Frame &f, serial::ByteVector_t &frame_buffer)
+{
+    build_frame_into(f.colors.data(), f.colors.size(), frame_buffer);
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelComms::build_frame_into(const animations::Color *colors, const size_t count,
+                                     serial::ByteVector_t &frame_buffer)
+{
+    //
+    // Size our frame buffer - how many bytes we will need to command some number
+    // of LED's. Every color byte turns into `symbol_bits` bytes on the wire. Once the
+    // buffer has been this big before, resizing it doesn't allocate
+    //
+    const size_t data_bytes = count * 3 * symbol_timing.symbol_bits;
+    frame_buffer.resize(data_bytes + latch_byte_count);
+    BYTE *out = frame_buffer.data();
+
+    //
+    // With a power limit the channel sums get added up in the same pass as the encoding.
+    // The frame went out with the brightness picked for the last one, so if this one
+    // needs a different brightness it gets encoded again with the new tables. That only
+    // happens when the brightness actually moves
+    //
+    if (limit.budget_ma > 0.0)
+    {
+        encode_colors<true>(colors, count, out);
+        if (apply_power_limit(count))
+        {
+            encode_colors<false>(colors, count, out);
+        }
+    }
+    else
+    {
+        encode_colors<false>(colors, count, out);
+    }
+    out += data_bytes;
+
+    //
+    // A reused buffer could have anything in it, so the latch gets zeroed every time
+    //
+    std::memset(out, 0x00, latch_byte_count);
+    serial::trace::mark(serial::trace::Stage::ENCODED);
+}
+
+//
+// ############################################################################
+//
+
+const NeopixelComms::SymbolTiming &NeopixelComms::timing() const
+{
+    return symbol_timing;
+}
+
+//
+// ############################################################################
+//
+
+size_t NeopixelComms::latch_bytes() const
+{
+    return latch_byte_count;
+}
+
+//
+// ############################################################################
+//
+
+double NeopixelComms::frame_wire_time_ns(const size_t led_count) const
+{
+    const size_t frame_bytes = led_count * 3 * symbol_timing.symbol_bits + latch_byte_count;
+    return frame_bytes * 8 * 1E9 / symbol_timing.spi_clock_hz;
+}
+
+//
+// ############################################################################
+//
+
+double NeopixelComms::SymbolTiming::bit_period_ns() const
+{
+    return symbol_bits * 1E9 / spi_clock_hz;
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelComms::set_color_correction(const ColorCorrection &correction_)
+{
+    correction = correction_;
+    build_correction();
+    build_channel_tables();
+}
+
+//
+// ############################################################################
+//
+
+const NeopixelComms::ColorCorrection &NeopixelComms::color_correction() const
+{
+    return correction;
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelComms::set_power_limit(const PowerLimit &limit_)
+{
+    limit = limit_;
+
+    //
+    // With no limit everything goes back to full brightness. Turning the limit on or off
+    // also changes how the tables round, so they get rebuilt either way
+    //
+    if (limit.budget_ma <= 0.0)
+    {
+        brightness_level = FULL_BRIGHTNESS;
+    }
+    build_channel_tables();
+}
+
+//
+// ############################################################################
+//
+
+const NeopixelComms::PowerLimit &NeopixelComms::power_limit() const
+{
+    return limit;
+}
+
+//
+// ############################################################################
+//
+
+double NeopixelComms::estimated_current_ma() const
+{
+    return current_estimate_ma;
+}
+
+//
+// ############################################################################
+//
+
+double NeopixelComms::brightness() const
+{
+    return static_cast<double>(brightness_level) / FULL_BRIGHTNESS;
+}
+
+//
+// ### static methods #########################################################
+//
+
+bool NeopixelComms::compute_timing(const double spi_clock_hz, SymbolTiming &timing)
+{
+    const Symbols symbols = symbols_for_clock(spi_clock_hz);
+    if (symbols.symbol_bits == 0)
+    {
+        return false;
+    }
+
+    timing.spi_clock_hz = spi_clock_hz;
+    timing.symbol_bits = symbols.symbol_bits;
+    timing.zero_high_bits = symbols.zero_high_bits;
+    timing.one_high_bits = symbols.one_high_bits;
+    return true;
+}
+
+//
+// ############################################################################
+//
+
+double NeopixelComms::best_spi_clock_hz(const double max_spi_clock_hz)
+{
+    double best_clock_hz = 0.0;
+    double best_period_ns = 0.0;
+
+    //
+    // Start at the fastest divisor that's allowed and walk down, anything under 1MHz
+    // can't possibly work
+    //
+    for (uint32_t divisor = serial::SerialConnection::spi_clock_divisor(max_spi_clock_hz); divisor <= 0xFFFF; ++divisor)
+    {
+        const double clock_hz = serial::SerialConnection::spi_clock_hz_for_divisor(divisor);
+        if (clock_hz > max_spi_clock_hz)
+        {
+            continue;
+        }
+        if (clock_hz < 1E6)
+        {
+            break;
+        }
+
+        SymbolTiming timing;
+        if (compute_timing(clock_hz, timing) == false)
+        {
+            continue;
+        }
+
+        //
+        // Only take a slower clock if it's actually better, ties go to the slower one
+        //
+        const double period_ns = timing.bit_period_ns();
+        if (best_clock_hz == 0.0 || period_ns <= best_period_ns + 0.5)
+        {
+            best_clock_hz = clock_hz;
+            best_period_ns = period_ns;
+        }
+    }
+
+    return best_clock_hz;
+}
+
+//
+// ### private methods ########################################################
+//
+
+void NeopixelComms::convert_byte_to_spi(const BYTE byte, BYTE *spi_bytes) const
+{
+    //
+    // Build up all 8 symbols as one long run of bits, MSB of the original byte first.
+    // That's `symbol_bits` bytes in total which we then write out MSB first too
+    //
+    const size_t symbol_bits = symbol_timing.symbol_bits;
+    std::fill(spi_bytes, spi_bytes + symbol_bits, 0x00);
+
+    size_t bit_index = 0;
+    BYTE mask = 0b10000000;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        const size_t high_bits = (byte & mask) == 0 ? symbol_timing.zero_high_bits : symbol_timing.one_high_bits;
+        for (size_t j = 0; j < high_bits; ++j)
+        {
+            const size_t index = bit_index + j;
+            spi_bytes[index / 8] |= 0x80 >> (index % 8);
+        }
+        bit_index += symbol_bits;
+        mask = mask >> 1;
+    }
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelComms::build_correction()
+{
+    const std::array<double, 3> temperature = color_temperature_scale(correction.color_temperature_k);
+    const std::array<double, 3> scale = {correction.red_balance * temperature[RED],
+                                         correction.green_balance * temperature[GREEN],
+                                         correction.blue_balance * temperature[BLUE]};
+
+    for (size_t c = 0; c < 3; ++c)
+    {
+        for (size_t byte = 0; byte < 256; ++byte)
+        {
+            const double corrected = 255.0 * std::pow(byte / 255.0, correction.gamma) * scale[c];
+            corrected_values[c][byte] =
+                static_cast<uint32_t>(std::round(std::min(std::max(corrected, 0.0), 255.0) * CORRECTED_SCALE));
+        }
+    }
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelComms::build_channel_tables()
+{
+    //
+    // Just integer math in here, this runs every time the brightness moves. Normally
+    // values round to the nearest, but with a power limit they round down: the current
+    // estimate comes from the unrounded values, so rounding any of them up could put
+    // the strip over the budget by half a step on every channel
+    //
+    const size_t symbol_bits = symbol_timing.symbol_bits;
+    constexpr uint32_t HALF = (static_cast<uint32_t>(CORRECTED_SCALE) * FULL_BRIGHTNESS) / 2;
+    const uint32_t rounding = limit.budget_ma > 0.0 ? 0 : HALF;
+    for (size_t c = 0; c < 3; ++c)
+    {
+        channel_tables[c].resize(byte_table.size());
+        for (size_t byte = 0; byte < 256; ++byte)
+        {
+            //
+            // Straight from the corrected and dimmed value to its encoded bits
+            //
+            const uint32_t value = (corrected_values[c][byte] * brightness_level + rounding) /
+                                   (static_cast<uint32_t>(CORRECTED_SCALE) * FULL_BRIGHTNESS);
+            std::memcpy(&channel_tables[c][byte * symbol_bits], &byte_table[value * symbol_bits], symbol_bits);
+        }
+    }
+}
+
+//
+// ############################################################################
+//
+
+template <bool SUM_CHANNELS>
+void NeopixelComms::encode_colors(const animations::Color *colors, const size_t count, BYTE *out)
+{
+    //
+    // Color correction and dimming are already in these tables
+    //
+    const size_t symbol_bits = symbol_timing.symbol_bits;
+    const BYTE *red_table = channel_tables[RED].data();
+    const BYTE *green_table = channel_tables[GREEN].data();
+    const BYTE *blue_table = channel_tables[BLUE].data();
+
+    const uint32_t *red = corrected_values[RED].data();
+    const uint32_t *green = corrected_values[GREEN].data();
+    const uint32_t *blue = corrected_values[BLUE].data();
+    uint64_t red_sum = 0;
+    uint64_t green_sum = 0;
+    uint64_t blue_sum = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const animations::Color color = colors[i];
+
+        //
+        // To set a color, send it's GRB color, each component should be
+        // sent MSB first.
+        //
+        std::memcpy(out, &green_table[color.G * symbol_bits], symbol_bits);
+        out += symbol_bits;
+        std::memcpy(out, &red_table[color.R * symbol_bits], symbol_bits);
+        out += symbol_bits;
+        std::memcpy(out, &blue_table[color.B * symbol_bits], symbol_bits);
+        out += symbol_bits;
+
+        if (SUM_CHANNELS)
+        {
+            red_sum += red[color.R];
+            green_sum += green[color.G];
+            blue_sum += blue[color.B];
+        }
+    }
+
+    if (SUM_CHANNELS)
+    {
+        channel_sums = {{red_sum, green_sum, blue_sum}};
+    }
+}
+
+//
+// ############################################################################
+//
+
+bool NeopixelComms::apply_power_limit(const size_t led_count)
+{
+    const double idle_ma = limit.idle_ma * led_count;
+    const double full_scale = 255.0 * CORRECTED_SCALE;
+    const double channel_ma =
+        limit.channel_ma * (channel_sums[RED] + channel_sums[GREEN] + channel_sums[BLUE]) / full_scale;
+    current_estimate_ma = idle_ma + channel_ma;
+
+    //
+    // Round the brightness down, and the tables round every dimmed value down too, so
+    // we always end up under the budget. If even the idle current is over budget
+    // there's nothing to do but go dark. A frame that's all black has nothing to dim,
+    // so it's left alone instead of dividing by zero
+    //
+    uint32_t level = FULL_BRIGHTNESS;
+    if (current_estimate_ma > limit.budget_ma && channel_ma > 0.0)
+    {
+        const double scale = std::max(limit.budget_ma - idle_ma, 0.0) / channel_ma;
+        level = static_cast<uint32_t>(std::floor(std::min(std::max(scale, 0.0), 1.0) * FULL_BRIGHTNESS));
+    }
+
+    if (level == brightness_level)
+    {
+        return false;
+    }
+    brightness_level = level;
+    build_channel_tables();
+    return true;
+}
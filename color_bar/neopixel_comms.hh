@@ -0,0 +1,330 @@
+#pragma once
+#include <algorithm>
+#include <array>
+
+#include "animations.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+//
+// Neopixel timing limits in nanoseconds. These are a little looser than the datasheet
+// since in practice all that matters is that a 0 is short, a 1 is long and the low
+// time after every bit is long enough to be seen. See
+// https://wp.josh.com/2014/05/13/ws2812-neopixels-are-not-so-finicky-once-you-get-to-know-them/
+//
+namespace neopixel_timing
+{
+
+constexpr double ZERO_HIGH_MIN_NS = 250.0;
+constexpr double ZERO_HIGH_MAX_NS = 550.0;
+constexpr double ZERO_HIGH_NOMINAL_NS = 400.0;
+constexpr double ONE_HIGH_MIN_NS = 650.0;
+constexpr double ONE_HIGH_MAX_NS = 1000.0;
+constexpr double LOW_MIN_NS = 450.0;
+constexpr double LOW_MAX_NS = 5000.0;
+constexpr double BIT_PERIOD_MIN_NS = 1200.0;
+
+//
+// Past this the clock is fast enough that we're just burning USB bandwidth
+//
+constexpr size_t MAX_SYMBOL_BITS = 48;
+
+//
+// What a Neopixel bit looks like in SPI bits at some clock, all zeros if the clock
+// can't make the timing. NeopixelComms works these out at run time and the static
+// tables (see static_animations.hh) at compile time, so both come from here
+//
+struct Symbols
+{
+    size_t symbol_bits;
+    size_t zero_high_bits;
+    size_t one_high_bits;
+};
+
+//
+// std::ceil isn't constexpr, this is the same thing for the positive numbers we need
+//
+constexpr size_t ceil_to_size(const double value)
+{
+    const size_t whole = static_cast<size_t>(value);
+    return whole < value ? whole + 1 : whole;
+}
+
+//
+// Smallest number of SPI bits that lasts at least `duration_ns`. The small fudge keeps
+// 450.0000001 / 150 from turning into 4 bits
+//
+constexpr size_t bits_for_at_least(const double duration_ns, const double spi_bit_ns)
+{
+    return ceil_to_size(duration_ns / spi_bit_ns - 1E-6);
+}
+
+//
+// The shortest symbols that meet the timing at `spi_clock_hz`
+//
+constexpr Symbols symbols_for_clock(const double spi_clock_hz)
+{
+    if (spi_clock_hz <= 0.0)
+    {
+        return {0, 0, 0};
+    }
+    const double spi_bit_ns = 1E9 / spi_clock_hz;
+
+    //
+    // A zero should be as close to nominal as we can get it. A one just has to be
+    // long enough, making it longer only makes the whole bit longer
+    //
+    size_t zero_high_bits = 0;
+    double zero_error_ns = 0.0;
+    for (size_t bits = 1; bits * spi_bit_ns <= ZERO_HIGH_MAX_NS; ++bits)
+    {
+        const double high_ns = bits * spi_bit_ns;
+        const double error_ns = high_ns > ZERO_HIGH_NOMINAL_NS ? high_ns - ZERO_HIGH_NOMINAL_NS
+                                                               : ZERO_HIGH_NOMINAL_NS - high_ns;
+        if (high_ns >= ZERO_HIGH_MIN_NS && (zero_high_bits == 0 || error_ns < zero_error_ns))
+        {
+            zero_high_bits = bits;
+            zero_error_ns = error_ns;
+        }
+    }
+
+    const size_t one_high_bits = std::max(bits_for_at_least(ONE_HIGH_MIN_NS, spi_bit_ns), zero_high_bits + 1);
+    if (zero_high_bits == 0 || one_high_bits * spi_bit_ns > ONE_HIGH_MAX_NS)
+    {
+        return {0, 0, 0};
+    }
+
+    const size_t symbol_bits = std::max(one_high_bits + bits_for_at_least(LOW_MIN_NS, spi_bit_ns),
+                                        bits_for_at_least(BIT_PERIOD_MIN_NS, spi_bit_ns));
+    if (symbol_bits > MAX_SYMBOL_BITS || (symbol_bits - zero_high_bits) * spi_bit_ns > LOW_MAX_NS)
+    {
+        return {0, 0, 0};
+    }
+
+    return {symbol_bits, zero_high_bits, one_high_bits};
+}
+
+//
+// Zero bytes it takes to hold the line low for `latch_time_us`. MOSI idles low, so
+// this is the whole latch
+//
+constexpr size_t latch_bytes_for(const double latch_time_us, const double spi_clock_hz)
+{
+    return ceil_to_size(latch_time_us * 1E-6 * spi_clock_hz / 8.0);
+}
+
+} // namespace neopixel_timing
+
+class NeopixelComms final : public animations::CommunicationBase
+{
+public: // types //////////////////////////////////////////////////////////////
+    //
+    // What a single Neopixel bit looks like on the SPI wire. Each Neopixel bit takes
+    // `symbol_bits` SPI bits, the first `zero_high_bits` or `one_high_bits` of them
+    // are high and the rest are low. Since there are 8 Neopixel bits in a color byte,
+    // every color byte turns into exactly `symbol_bits` SPI bytes
+    //
+    struct SymbolTiming
+    {
+        double spi_clock_hz = 0.0;
+        size_t symbol_bits = 0;
+        size_t zero_high_bits = 0;
+        size_t one_high_bits = 0;
+
+        //
+        // How long one Neopixel bit takes on the wire
+        //
+        double bit_period_ns() const;
+    };
+
+    //
+    // Per channel correction applied on the way out. Gamma goes first, then the white
+    // balance and color temperature scales. The defaults leave colors alone
+    //
+    struct ColorCorrection
+    {
+        double gamma = 1.0;
+
+        double red_balance = 1.0;
+        double green_balance = 1.0;
+        double blue_balance = 1.0;
+
+        //
+        // Color temperature of white in Kelvin, 6500 leaves white alone and lower
+        // values make it warmer
+        //
+        double color_temperature_k = 6500.0;
+    };
+
+    //
+    // How much current the strip is allowed to pull. A WS2812 draws roughly 20mA per
+    // channel at full brightness plus about 1mA just for being powered, so a full white
+    // strip is 61mA per LED. A budget of 0 means no limit
+    //
+    struct PowerLimit
+    {
+        double budget_ma = 0.0;
+        double channel_ma = 20.0;
+        double idle_ma = 1.0;
+    };
+
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // Build an encoder for an SPI clock, this should be the rate the clock actually
+    // ended up at (see SerialConnection::configure_spi_defaults) not the one asked for.
+    //
+    // Every frame ends with at least `latch_time_us` of low so the strip latches it
+    // before the next frame starts. The original WS2812 only needs 50us but the newer
+    // WS2812B parts want closer to 280us, so the default covers both
+    //
+    NeopixelComms(const double spi_clock_hz = 5E6, const double latch_time_us = 300.0);
+
+    //
+    //
+    //
+    ~NeopixelComms() {};
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Send a frame to the neopixel display one byte at a time. The latch is part of
+    // the frame so frames can be written back to back without sleeping in between
+    //
+    serial::ByteVector_t build_frame(const animations::Frame &f);
+
+    //
+    // Same as build_frame but encodes `count` colors into a buffer the caller keeps
+    // around, so a loop that reuses the same buffer never allocates
+    //
+    void build_frame_into(const animations::Color *colors, const size_t count, serial::ByteVector_t &frame_buffer);
+    void build_frame_into(const animations::Frame &f, serial::ByteVector_t &frame_buffer) override;
+
+    //
+    // The symbols we're using
+    //
+    const SymbolTiming &timing() const;
+
+    //
+    // Number of zero bytes at the end of every frame for the latch
+    //
+    size_t latch_bytes() const;
+
+    //
+    // How long (in nanoseconds) a frame of `led_count` LEDs takes on the wire, latch
+    // included. Back to back frames can't go any faster than this
+    //
+    double frame_wire_time_ns(const size_t led_count) const;
+
+    //
+    // Change the color correction. The correction is baked into the encoding tables,
+    // so it costs nothing per frame, build_frame is still just one pass of lookups
+    //
+    void set_color_correction(const ColorCorrection &correction);
+
+    const ColorCorrection &color_correction() const;
+
+    //
+    // Limit how much current frames can pull. When a frame would go over the budget
+    // every LED is dimmed by the same amount to bring it back under, the colors stay
+    // the same just darker
+    //
+    void set_power_limit(const PowerLimit &limit);
+
+    const PowerLimit &power_limit() const;
+
+    //
+    // What the last frame would have drawn without any dimming, and how much it was
+    // dimmed by (1 is full brightness)
+    //
+    double estimated_current_ma() const;
+    double brightness() const;
+
+public: // static methods /////////////////////////////////////////////////////
+    //
+    // Figure out the shortest symbols that meet the Neopixel timing at this clock.
+    // Returns false if the clock is too slow (or too fast) to hit the timing at all
+    //
+    static bool compute_timing(const double spi_clock_hz, SymbolTiming &timing);
+
+    //
+    // Search every clock the MPSSE can make at or below `max_spi_clock_hz` and return
+    // the one that gives the shortest Neopixel bit. When two clocks tie the slower one
+    // wins since it means fewer bytes over USB
+    //
+    static double best_spi_clock_hz(const double max_spi_clock_hz = 30E6);
+
+private: // methods ///////////////////////////////////////////////////////////
+    //
+    // Take a byte in and write out `symbol_bits` funky SPI formatted bytes.
+    // Since the Neopixel communicates in a weird protocol, this
+    // conversion is required.
+    //
+    void convert_byte_to_spi(const BYTE byte, BYTE *spi_bytes) const;
+
+    //
+    // Recompute `corrected_values` for the color correction
+    //
+    void build_correction();
+
+    //
+    // Rebuild `channel_tables` from `byte_table`, the corrected values and the brightness
+    //
+    void build_channel_tables();
+
+    //
+    // Encode `count` colors into `out` with the current tables. With SUM_CHANNELS the
+    // corrected channel values get added up into `channel_sums` along the way
+    //
+    template <bool SUM_CHANNELS>
+    void encode_colors(const animations::Color *colors, const size_t count, BYTE *out);
+
+    //
+    // Pick the brightness for the current channel sums, rebuilding the tables if it
+    // moved. Returns true if it did
+    //
+    bool apply_power_limit(const size_t led_count);
+
+private: // members ///////////////////////////////////////////////////////////
+    //
+    // Symbols for the clock we were built with
+    //
+    SymbolTiming symbol_timing;
+
+    //
+    // Zero bytes appended to each frame, enough to cover the latch time at our clock
+    //
+    size_t latch_byte_count;
+
+    //
+    // Every possible color byte already converted, `symbol_bits` bytes per entry
+    //
+    serial::ByteVector_t byte_table;
+
+    //
+    // The same as `byte_table` but with each channel's correction applied, so looking
+    // up a red byte here gives the encoded bits for the corrected red value
+    //
+    enum channel : size_t
+    {
+        RED = 0,
+        GREEN = 1,
+        BLUE = 2
+    };
+    std::array<serial::ByteVector_t, 3> channel_tables;
+
+    ColorCorrection correction;
+
+    //
+    // What each channel value turns into after the color correction, before it's
+    // dimmed. These are in 1/256ths so rounding only happens once at the very end
+    //
+    std::array<std::array<uint32_t, 256>, 3> corrected_values;
+
+    //
+    // Power limiting state. The sums are of the corrected (but not dimmed) channel
+    // values of the last frame encoded. Brightness is kept in 1/256 steps (256 is full)
+    // so the tables only get rebuilt when it moves by a visible amount
+    //
+    PowerLimit limit;
+    std::array<uint64_t, 3> channel_sums;
+    double current_estimate_ma;
+    uint32_t brightness_level;
+};
@@ -1,74 +1,551 @@
+#include <boost/make_shared.hpp>
 #include <boost/python.hpp>
 #include <iostream>
 #include <thread>
 
+#include "compositor.hh"
+#include "frame_sequence.hh"
 #include "neopixel_driver.hh"
+#include "parallel_animations.hh"
+#include "../ftd2xx_driver/trace.hh"
+#include "../ftd2xx_driver/usb_tuning.hh"
+
+namespace
+{
 
 //
-// ### public methods #########################################################
+// Let go of the GIL for as long as this is around
 //
+class ScopedGilRelease
+{
+public: // constructor ////////////////////////////////////////////////////////
+    ScopedGilRelease() : state(PyEval_SaveThread())
+    {
+    }
+
+    ~ScopedGilRelease()
+    {
+        PyEval_RestoreThread(state);
+    }
+
+private: // members ///////////////////////////////////////////////////////////
+    PyThreadState *state;
+};
 
-serial::ByteVector_t NeopixelComms::build_frame(const animations::Frame &f)
+//
+// Runs on the event loop's thread. The Future could have been cancelled while the frame
+// was being written, and setting a result then would raise
+//
+void resolve_future(boost::python::object future, const bool success)
 {
+    if (boost::python::extract<bool>(future.attr("done")()) == false)
+    {
+        future.attr("set_result")(success);
+    }
+}
+
+}
+
+constexpr double PythonController::DEFAULT_REFRESH_INTERVAL_MS;
+
+//
+// ############################################################################
+//
+
+PythonController::PythonController(const size_t led_count_, const size_t pixel_groups_)
+    : led_count(led_count_), serial(), frame_pool(led_count_, MAX_PENDING + 1), stopping(false)
+{
+    //
+    // Run at whatever clock gets each Neopixel bit out the fastest, then build the
+    // encoder for the clock we really got
+    //
+    comms = NeopixelComms(serial.configure_spi_defaults(NeopixelComms::best_spi_clock_hz()));
+
     //
-    // Reserve our frame buffer - how many bytes we will need
-    // to command some number of LED's. Multiply that by 8 since it
-    // takes us one byte to transmit one bit
+    // Percent bars spend most of their time sending the same thing over and over
     //
-    serial::ByteVector_t frame_buffer;
-    frame_buffer.reserve(f.colors.size() * 3 * 8);
+    serial.set_skip_duplicate_frames(true, DEFAULT_REFRESH_INTERVAL_MS);
 
-    for (const animations::Color color : f.colors)
+    animations::Frame blank;
+    blank.colors = std::vector<animations::Color>(led_count, animations::RED);
+
+    serial::ByteVector_t blank_frame = comms.build_frame(blank);
+
+    //
+    // If this strip length has been calibrated before use whatever won last time
+    //
+    serial::UsbSettings usb_settings;
+    if (serial::load_usb_settings(serial::default_usb_settings_path(), blank_frame.size(), usb_settings))
     {
-        //
-        // To set a color, send it's GRB color, each component should be
-        // sent MSB first.
-        //
-        for (const BYTE green_bit : convert_byte_to_spi(color.G))
-            frame_buffer.push_back(green_bit);
-        for (const BYTE red_bit : convert_byte_to_spi(color.R))
-            frame_buffer.push_back(red_bit);
-        for (const BYTE blue_bit : convert_byte_to_spi(color.B))
-            frame_buffer.push_back(blue_bit);
+        serial.set_usb_parameters(usb_settings);
     }
-    return std::move(frame_buffer);
+
+    serial.spi_write_data(std::move(blank_frame));
+
+    worker = std::thread(&PythonController::run_worker, this);
 }
 
 //
-// ### private methods ########################################################
+// ############################################################################
 //
 
-serial::ByteVector_t NeopixelComms::convert_byte_to_spi(const BYTE &byte)
+PythonController::~PythonController()
 {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_changed.notify_all();
+
     //
-    // We will return a ByteVector composed of 8 bytes. The MSB of the original
-    // byte will be the zeroth index in the vector
+    // The worker might be waiting on the GIL to finish off a job, so we can't be
+    // holding it while we wait for the worker
     //
-    serial::ByteVector_t bytes(8);
-    BYTE mask = 0b10000000;
-    for (size_t i = 0; i < 8; ++i)
     {
-        bytes[i] = static_cast<int>(byte & mask) == 0 ? ZERO : ONE;
-        mask = mask >> 1;
+        ScopedGilRelease release;
+        worker.join();
     }
 
-    return bytes;
+    //
+    // Anything still queued never gets written, but whoever is awaiting it still needs
+    // an answer or they'd wait forever
+    //
+    for (Job &job : queue)
+    {
+        finish_job(job, false);
+    }
 }
 
 //
 // ############################################################################
 //
 
-PythonController::PythonController(const size_t led_count_, const size_t pixel_groups_)
-    : led_count(led_count_), serial()
+bool PythonController::update_frame(const animations::Frame &frame)
 {
-    serial.configure_spi_defaults(5E6);
+    serial::trace::ScopedFrame trace_frame;
+    serial::trace::mark(serial::trace::Stage::GENERATED);
+
+    ScopedGilRelease release;
+    return write_frame(frame);
+}
+
+//
+// ############################################################################
+//
+
+boost::python::object PythonController::submit(const animations::Frame &frame)
+{
+    using namespace boost::python;
+    serial::trace::ScopedFrame trace_frame;
+    serial::trace::mark(serial::trace::Stage::GENERATED);
+
+    object loop = import("asyncio").attr("get_running_loop")();
+    object future = loop.attr("create_future")();
+
+    //
+    // The copy goes into a recycled frame, so submitting doesn't allocate once the pool
+    // has warmed up
+    //
+    Job job;
+    job.frame = frame_pool.acquire();
+    job.frame.colors.assign(frame.colors.begin(), frame.colors.end());
+    job.frame.hold_time_ms = frame.hold_time_ms;
+    job.future = incref(future.ptr());
+    job.loop = incref(loop.ptr());
+    job.trace_frame = serial::trace::current_frame();
+
+    std::deque<Job> skipped;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue.push_back(std::move(job));
+        serial::trace::mark(serial::trace::Stage::ENQUEUED);
+        while (queue.size() > MAX_PENDING)
+        {
+            skipped.push_back(std::move(queue.front()));
+            queue.pop_front();
+        }
+    }
+    queue_changed.notify_one();
+
+    for (Job &old_job : skipped)
+    {
+        finish_job(old_job, false);
+        frame_pool.release(std::move(old_job.frame));
+    }
+    return future;
+}
+
+//
+// ############################################################################
+//
+
+size_t PythonController::pending() const
+{
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return queue.size();
+}
+
+//
+// ############################################################################
+//
+
+bool PythonController::calibrate_usb()
+{
+    ScopedGilRelease release;
+    std::lock_guard<std::mutex> lock(output_mutex);
 
     animations::Frame blank;
-    blank.colors = std::vector<animations::Color>(led_count, animations::RED);
+    blank.colors = std::vector<animations::Color>(led_count);
+
+    const size_t frame_size = comms.build_frame(blank).size();
+
+    serial::CalibrationResult best;
+    if (serial::calibrate_usb(serial, frame_size, best) == false)
+    {
+        return false;
+    }
+    return serial::save_usb_settings(serial::default_usb_settings_path(), frame_size, best.settings);
+}
+
+//
+// ############################################################################
+//
+
+bool PythonController::start_capture(const std::string &path)
+{
+    auto capture = std::make_shared<serial::CaptureWriter>(path);
+    if (capture->is_open() == false)
+    {
+        return false;
+    }
+    ScopedGilRelease release;
+    std::lock_guard<std::mutex> lock(output_mutex);
+    serial.set_capture(capture);
+    return true;
+}
+
+//
+// ############################################################################
+//
+
+void PythonController::stop_capture()
+{
+    ScopedGilRelease release;
+    std::lock_guard<std::mutex> lock(output_mutex);
+    serial.set_capture(nullptr);
+}
+
+//
+// ############################################################################
+//
+
+void PythonController::set_color_correction(const NeopixelComms::ColorCorrection &correction)
+{
+    ScopedGilRelease release;
+    std::lock_guard<std::mutex> lock(output_mutex);
+    comms.set_color_correction(correction);
+}
+
+//
+// ############################################################################
+//
+
+NeopixelComms::ColorCorrection PythonController::color_correction() const
+{
+    std::lock_guard<std::mutex> lock(output_mutex);
+    return comms.color_correction();
+}
+
+//
+// ############################################################################
+//
+
+void PythonController::set_power_limit(const NeopixelComms::PowerLimit &limit)
+{
+    ScopedGilRelease release;
+    std::lock_guard<std::mutex> lock(output_mutex);
+    comms.set_power_limit(limit);
+}
+
+//
+// ############################################################################
+//
+
+void PythonController::set_skip_duplicate_frames(const bool skip, const double refresh_interval_ms)
+{
+    ScopedGilRelease release;
+    std::lock_guard<std::mutex> lock(output_mutex);
+    serial.set_skip_duplicate_frames(skip, refresh_interval_ms);
+}
+
+//
+// ############################################################################
+//
+
+double PythonController::estimated_current_ma() const
+{
+    std::lock_guard<std::mutex> lock(output_mutex);
+    return comms.estimated_current_ma();
+}
+
+//
+// ############################################################################
+//
+
+double PythonController::brightness() const
+{
+    std::lock_guard<std::mutex> lock(output_mutex);
+    return comms.brightness();
+}
+
+//
+// ############################################################################
+//
+
+serial::MetricsSnapshot PythonController::metrics() const
+{
+    return serial.metrics().snapshot();
+}
+
+//
+// ### private methods ########################################################
+//
+
+bool PythonController::write_frame(const animations::Frame &frame)
+{
+    std::lock_guard<std::mutex> lock(output_mutex);
+
+    const uint64_t encode_start_ns = serial::now_ns();
+    comms.build_frame_into(frame.colors.data(), frame.colors.size(), encoded);
+    serial.metrics().record_frame_played((serial::now_ns() - encode_start_ns) / 1000);
+
+    return serial.spi_write_data(encoded.data(), encoded.size(), packet);
+}
+
+//
+// ############################################################################
+//
+
+void PythonController::run_worker()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_changed.wait(lock, [this] { return stopping || queue.empty() == false; });
+            if (stopping)
+            {
+                return;
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        serial::trace::ScopedFrame trace_frame(job.trace_frame);
+        finish_job(job, write_frame(job.frame));
+        frame_pool.release(std::move(job.frame));
+    }
+}
+
+//
+// ############################################################################
+//
+
+void PythonController::finish_job(Job &job, const bool success)
+{
+    using namespace boost::python;
+    const PyGILState_STATE gil = PyGILState_Ensure();
+    try
+    {
+        //
+        // Futures aren't thread safe, so the result gets set from the loop's thread
+        //
+        object loop(handle<>(borrowed(job.loop)));
+        object future(handle<>(borrowed(job.future)));
+        loop.attr("call_soon_threadsafe")(make_function(&resolve_future), future, success);
+    }
+    catch (const error_already_set &)
+    {
+        //
+        // The loop was closed, so nobody's waiting on this any more
+        //
+        PyErr_Clear();
+    }
+
+    Py_DECREF(job.future);
+    Py_DECREF(job.loop);
+    job.future = nullptr;
+    job.loop = nullptr;
+    PyGILState_Release(gil);
+}
+
+//
+// ############################################################################
+//
+
+namespace
+{
+
+//
+// Python doesn't know what a std::vector is, so histograms go out as lists
+//
+template <std::vector<uint64_t> serial::MetricsSnapshot::*member>
+boost::python::list histogram_to_list(const serial::MetricsSnapshot &s)
+{
+    boost::python::list result;
+    for (const uint64_t count : s.*member)
+    {
+        result.append(count);
+    }
+    return result;
+}
+
+//
+// Layers come in from Python as lists of Colors
+//
+void set_layer_from_list(animations::Compositor &compositor, const size_t layer, const boost::python::list &colors)
+{
+    const size_t count = boost::python::len(colors);
+    std::vector<animations::Color> layer_colors(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        layer_colors[i] = boost::python::extract<animations::Color>(colors[i]);
+    }
+    compositor.set_layer(layer, layer_colors);
+}
+
+//
+// Frames can be made from a list of Colors
+//
+boost::shared_ptr<animations::Frame> frame_from_list(const boost::python::list &colors)
+{
+    boost::shared_ptr<animations::Frame> frame(new animations::Frame());
+    const size_t count = boost::python::len(colors);
+    frame->colors.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        frame->colors[i] = boost::python::extract<animations::Color>(colors[i]);
+    }
+    return frame;
+}
+
+//
+// Sequences can be made from a list of Frames. There's no way to add frames from Python
+// after that, growing the sequence would move its colors out from under any numpy
+// array that's looking at them
+//
+boost::shared_ptr<animations::FrameSequence> sequence_from_list(const boost::python::list &frames)
+{
+    const size_t count = boost::python::len(frames);
+    std::vector<animations::Frame> frame_list(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        frame_list[i] = boost::python::extract<animations::Frame>(frames[i]);
+    }
+    return boost::make_shared<animations::FrameSequence>(animations::FrameSequence::from_frames(frame_list));
+}
+
+//
+// Frame.colors goes back and forth as a list of Colors
+//
+boost::python::list colors_to_list(const animations::Frame &frame)
+{
+    boost::python::list result;
+    for (const animations::Color &color : frame.colors)
+    {
+        result.append(color);
+    }
+    return result;
+}
+
+void set_colors_from_list(animations::Frame &frame, const boost::python::list &colors)
+{
+    const size_t count = boost::python::len(colors);
+    frame.colors.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        frame.colors[i] = boost::python::extract<animations::Color>(colors[i]);
+    }
+}
+
+//
+// numpy picks this up and makes an array that points straight at the sequence's memory,
+// shaped frames x LEDs x RGBA. The array holds on to the sequence so it can't go away
+// underneath it, and nothing in the Python API can resize it
+//
+boost::python::dict array_interface(animations::FrameSequence &sequence)
+{
+    using namespace boost::python;
+    dict interface;
+    interface["shape"] = make_tuple(sequence.frame_count(), sequence.led_count(), sizeof(animations::Color));
+    interface["typestr"] = "|u1";
+    interface["data"] = make_tuple(reinterpret_cast<uintptr_t>(sequence.data()), false);
+    interface["version"] = 3;
+    return interface;
+}
+
+boost::python::list hold_times_to_list(const animations::FrameSequence &sequence)
+{
+    boost::python::list result;
+    for (const unsigned long hold_time_ms : sequence.hold_times_ms())
+    {
+        result.append(hold_time_ms);
+    }
+    return result;
+}
+
+//
+// Generators go out to Python as sequences, so they show up in numpy without a copy. They
+// go out as shared pointers too, otherwise Boost.Python copies the whole show on the way
+//
+boost::shared_ptr<animations::FrameSequence> green_percent_bar_sequence(const double percent,
+                                                                        const size_t led_count)
+{
+    return boost::make_shared<animations::FrameSequence>(
+        animations::FrameSequence::from_frames({animations::green_percent_bar(percent, led_count)}));
+}
+
+//
+// Long shows get made on all the cores with the GIL let go. One pool for the whole
+// module, made the first time it's needed
+//
+animations::ThreadPool &precompute_pool()
+{
+    static animations::ThreadPool pool;
+    return pool;
+}
+
+boost::shared_ptr<animations::FrameSequence> green_percent_bar_ramp_sequence(const double percent_start,
+                                                                             const double percent_end,
+                                                                             const size_t led_count,
+                                                                             const unsigned long duration_ms,
+                                                                             const size_t step_count)
+{
+    auto sequence = boost::make_shared<animations::FrameSequence>(led_count);
+    ScopedGilRelease release;
+    animations::green_percent_bar_ramp_into(
+        precompute_pool(), percent_start, percent_end, led_count, duration_ms, step_count, *sequence);
+    return sequence;
+}
+
+boost::shared_ptr<animations::FrameSequence> fade_sequence(const animations::Frame &frame_start,
+                                                           const animations::Frame &frame_end,
+                                                           const double duration_ms,
+                                                           const size_t step_count)
+{
+    auto sequence = boost::make_shared<animations::FrameSequence>(frame_start.colors.size());
+    ScopedGilRelease release;
+    animations::fade_into(precompute_pool(), frame_start, frame_end, duration_ms, step_count, *sequence);
+    return sequence;
+}
+
+template <std::vector<uint64_t> serial::MetricsSnapshot::*member>
+uint64_t histogram_percentile(const serial::MetricsSnapshot &s, const double percentile)
+{
+    return serial::MetricsSnapshot::percentile_us(s.*member, percentile);
+}
 
-    NeopixelComms comms;
-    serial.spi_write_data(comms.build_frame(blank));
 }
 
 //
@@ -79,17 +556,117 @@ BOOST_PYTHON_MODULE(neopixel_driver)
 {
     // This only lets someone animate a green/red bar for the performance meter
     using namespace boost::python;
+
+#if PY_VERSION_HEX < 0x03070000
+    //
+    // Older Pythons don't set up the GIL until asked, and the output thread needs it
+    //
+    PyEval_InitThreads();
+#endif
+
     class_<animations::Color>("Color")
         .def(init<animations::uchar_t, animations::uchar_t, animations::uchar_t>())
+        .def(init<animations::uchar_t, animations::uchar_t, animations::uchar_t, animations::uchar_t>())
         .def_readwrite("r", &animations::Color::R)
         .def_readwrite("g", &animations::Color::G)
-        .def_readwrite("b", &animations::Color::B);
+        .def_readwrite("b", &animations::Color::B)
+        .def_readwrite("a", &animations::Color::A);
 
     class_<animations::Frame>("Frame")
         .def(init<const std::vector<animations::Color>&>())
-        .def_readwrite("colors", &animations::Frame::colors);
+        .def("__init__", make_constructor(&frame_from_list))
+        .def_readwrite("hold_time_ms", &animations::Frame::hold_time_ms)
+        .add_property("colors", &colors_to_list, &set_colors_from_list);
+
+    using animations::FrameSequence;
+    class_<FrameSequence, boost::shared_ptr<FrameSequence>, boost::noncopyable>("FrameSequence", no_init)
+        .def("__init__", make_constructor(&sequence_from_list))
+        .def("frame", &FrameSequence::frame)
+        .def("frame_count", &FrameSequence::frame_count)
+        .def("led_count", &FrameSequence::led_count)
+        .def("__len__", &FrameSequence::frame_count)
+        .add_property("__array_interface__", &array_interface)
+        .add_property("hold_times_ms", &hold_times_to_list);
+
+    def("green_percent_bar", &green_percent_bar_sequence);
+    def("green_percent_bar_ramp", &green_percent_bar_ramp_sequence,
+        (arg("percent_start"), arg("percent_end"), arg("led_count"), arg("duration_ms"), arg("step_count") = 100));
+    def("fade", &fade_sequence,
+        (arg("frame_start"), arg("frame_end"), arg("duration_ms"), arg("step_count") = 100));
 
-    // class_<PythonController>("NeoPixelDriver", init<const size_t>())
-    //     .def("update_pixel", &PythonController::update_percent)
-    //     .def("update_pixel_group", &PythonController::update_percent);
+    enum_<animations::BlendMode>("BlendMode")
+        .value("NORMAL", animations::BlendMode::NORMAL)
+        .value("ADD", animations::BlendMode::ADD)
+        .value("MULTIPLY", animations::BlendMode::MULTIPLY)
+        .value("SCREEN", animations::BlendMode::SCREEN);
+
+    using animations::Compositor;
+    class_<Compositor>("Compositor", init<const size_t>())
+        .def("add_layer", &Compositor::add_layer,
+             (arg("mode") = animations::BlendMode::NORMAL, arg("opacity") = 255))
+        .def("set_layer", &set_layer_from_list)
+        .def("clear_layer", &Compositor::clear_layer)
+        .def("set_blend_mode", &Compositor::set_blend_mode)
+        .def("set_opacity", &Compositor::set_opacity)
+        .def("composite", &Compositor::composite, return_value_policy<copy_const_reference>())
+        .def("layer_count", &Compositor::layer_count);
+
+    using Snapshot = serial::MetricsSnapshot;
+    class_<Snapshot>("MetricsSnapshot")
+        .def_readonly("timestamp_ns", &Snapshot::timestamp_ns)
+        .def_readonly("writes", &Snapshot::writes)
+        .def_readonly("bytes_written", &Snapshot::bytes_written)
+        .def_readonly("short_writes", &Snapshot::short_writes)
+        .def_readonly("write_errors", &Snapshot::write_errors)
+        .add_property("error_codes", &histogram_to_list<&Snapshot::error_codes>)
+        .add_property("write_latency_us", &histogram_to_list<&Snapshot::write_latency_us>)
+        .def_readonly("write_latency_max_us", &Snapshot::write_latency_max_us)
+        .def_readonly("write_latency_total_us", &Snapshot::write_latency_total_us)
+        .def_readonly("frames_written", &Snapshot::frames_written)
+        .def_readonly("frames_skipped", &Snapshot::frames_skipped)
+        .add_property("frame_interval_us", &histogram_to_list<&Snapshot::frame_interval_us>)
+        .def_readonly("frames_per_second", &Snapshot::frames_per_second)
+        .def_readonly("frames_played", &Snapshot::frames_played)
+        .add_property("encode_latency_us", &histogram_to_list<&Snapshot::encode_latency_us>)
+        .def("write_latency_percentile_us", &histogram_percentile<&Snapshot::write_latency_us>)
+        .def("frame_interval_percentile_us", &histogram_percentile<&Snapshot::frame_interval_us>)
+        .def("encode_latency_percentile_us", &histogram_percentile<&Snapshot::encode_latency_us>);
+
+    using Correction = NeopixelComms::ColorCorrection;
+    class_<Correction>("ColorCorrection")
+        .def_readwrite("gamma", &Correction::gamma)
+        .def_readwrite("red_balance", &Correction::red_balance)
+        .def_readwrite("green_balance", &Correction::green_balance)
+        .def_readwrite("blue_balance", &Correction::blue_balance)
+        .def_readwrite("color_temperature_k", &Correction::color_temperature_k);
+
+    using Limit = NeopixelComms::PowerLimit;
+    class_<Limit>("PowerLimit")
+        .def_readwrite("budget_ma", &Limit::budget_ma)
+        .def_readwrite("channel_ma", &Limit::channel_ma)
+        .def_readwrite("idle_ma", &Limit::idle_ma);
+
+    class_<PythonController, boost::noncopyable>("NeoPixelDriver", init<const size_t, const size_t>())
+        .def("update_frame", &PythonController::update_frame)
+        .def("submit", &PythonController::submit)
+        .def("pending", &PythonController::pending)
+        .def("metrics", &PythonController::metrics)
+        .def("calibrate_usb", &PythonController::calibrate_usb)
+        .def("start_capture", &PythonController::start_capture)
+        .def("stop_capture", &PythonController::stop_capture)
+        .def("set_color_correction", &PythonController::set_color_correction)
+        .def("color_correction", &PythonController::color_correction)
+        .def("set_power_limit", &PythonController::set_power_limit)
+        .def("estimated_current_ma", &PythonController::estimated_current_ma)
+        .def("brightness", &PythonController::brightness)
+        .def("set_skip_duplicate_frames", &PythonController::set_skip_duplicate_frames,
+             (arg("skip"), arg("refresh_interval_ms") = PythonController::DEFAULT_REFRESH_INTERVAL_MS));
+
+    //
+    // Per frame stage tracing, write_trace dumps what's been traced as Chrome trace JSON
+    //
+    def("enable_tracing", &serial::trace::enable);
+    def("tracing_enabled", &serial::trace::enabled);
+    def("write_trace", &serial::trace::write_chrome_trace);
+    def("clear_trace", &serial::trace::clear);
 }
@@ -1,48 +1,151 @@
 #pragma once
+#include <boost/python.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 #include "animations.hh"
+#include "frame_pool.hh"
+#include "neopixel_comms.hh"
 #include "../ftd2xx_driver/serial.hh"
 
-class NeopixelComms final : public animations::CommunicationBase
+class PythonController
 {
-public: // destructor /////////////////////////////////////////////////////////
+public: // constants /////////////////////////////////////////////////////////
     //
+    // How often a frame that hasn't changed gets sent again anyway
+    //
+    static constexpr double DEFAULT_REFRESH_INTERVAL_MS = 1000.0;
+
+public: // constructor ///////////////////////////////////////////////////////
+    PythonController(const size_t led_count_, const size_t pixel_groups_);
+
     //
+    // There's a thread in here, so no copies
     //
-    ~NeopixelComms() {};
+    PythonController(const PythonController &p) = delete;
 
-public: // types //////////////////////////////////////////////////////////////
-    enum bits : unsigned char
-    {
-        ZERO = 0xC0,
-        ONE = 0xF8
-    };
+    //
+    // Frames that haven't gone out yet are dropped, and their Futures resolve to false
+    //
+    ~PythonController();
 
-public: // methods ////////////////////////////////////////////////////////////
+public: // public methods ////////////////////////////////////////////////////
     //
-    // Send a frame to the neopixel display one byte at a time
+    // Encode and send a frame right now. The GIL is let go while it's being written so
+    // other Python threads keep running
     //
-    serial::ByteVector_t build_frame(const animations::Frame &f);
+    bool update_frame(const animations::Frame &frame);
 
-private: // methods ///////////////////////////////////////////////////////////
     //
-    // Take a byte in and return a funky SPI formatted ByteVector.
-    // Since the Neopixel communicates in a weird protocol, this
-    // conversion is required.
+    // Hand a frame to the output thread and return an asyncio Future (on the running
+    // event loop, so this has to be called from a coroutine) right away. The Future's
+    // result is true once the frame is written, or false if the write failed or the
+    // frame got skipped because newer ones piled up behind it
     //
-    serial::ByteVector_t convert_byte_to_spi(const BYTE &byte);
+    boost::python::object submit(const animations::Frame &frame);
 
-};
+    //
+    // Frames submitted that haven't been written yet
+    //
+    size_t pending() const;
 
-class PythonController
-{
-public: // constructor ///////////////////////////////////////////////////////
-    PythonController(const size_t led_count_, const size_t pixel_groups_);
-    PythonController(const PythonController &p) = default;
+    //
+    // Stats about everything we've pushed out to the strip so far
+    //
+    serial::MetricsSnapshot metrics() const;
 
-public: // public methods ////////////////////////////////////////////////////
-    void update_frame(const std::vector<uint8_t> &frame);
+    //
+    // Try out a bunch of USB settings for our frame size, keep the best one and save
+    // it so the next time we start up with this many LEDs we use it right away. Returns
+    // false (and saves nothing) if no setting beat the defaults by more than the
+    // measurements wander from run to run
+    //
+    bool calibrate_usb();
+
+    //
+    // Start (or stop) recording everything that goes out to the strip into a capture
+    // file that tools/replay_capture.cc can play back later
+    //
+    bool start_capture(const std::string &path);
+    void stop_capture();
+
+    //
+    // Gamma, white balance and color temperature for everything sent from now on
+    //
+    void set_color_correction(const NeopixelComms::ColorCorrection &correction);
+    NeopixelComms::ColorCorrection color_correction() const;
+
+    //
+    // Keep the strip under a current budget, and what the last frame pulled before
+    // and after dimming
+    //
+    void set_power_limit(const NeopixelComms::PowerLimit &limit);
+    double estimated_current_ma() const;
+    double brightness() const;
+
+    //
+    // Don't resend a frame that's the same as the last one, except every
+    // `refresh_interval_ms` in case the strip glitched. This is on by default
+    //
+    void set_skip_duplicate_frames(const bool skip, const double refresh_interval_ms);
+
+private: // private types ////////////////////////////////////////////////////
+    //
+    // A submitted frame and the Future (and its loop) to tell when it's done. These
+    // hold references, so they can only be let go of with the GIL
+    //
+    struct Job
+    {
+        animations::Frame frame;
+        PyObject *future;
+        PyObject *loop;
+
+        //
+        // So the worker's stages go on the same frame in the trace
+        //
+        uint64_t trace_frame;
+    };
+
+private: // private methods //////////////////////////////////////////////////
+    //
+    // Encode and write while holding `output_mutex`, but not the GIL
+    //
+    bool write_frame(const animations::Frame &frame);
+
+    //
+    // Runs on `worker`, writing jobs until told to stop
+    //
+    void run_worker();
+
+    //
+    // Set a job's Future from the worker thread (this takes the GIL) and let go of it
+    //
+    static void finish_job(Job &job, const bool success);
 
 private: // private members //////////////////////////////////////////////////
     size_t led_count;
     serial::SerialConnection serial;
+    NeopixelComms comms;
+
+    //
+    // The worker and Python both use the encoder and the connection, and these buffers
+    // get reused for every frame
+    //
+    mutable std::mutex output_mutex;
+    serial::ByteVector_t encoded;
+    serial::ByteVector_t packet;
+
+    //
+    // Submitted jobs, oldest first. Past `MAX_PENDING` the oldest get skipped, a strip
+    // showing something from a second ago isn't useful
+    //
+    static constexpr size_t MAX_PENDING = 4;
+    animations::FramePool frame_pool;
+    mutable std::mutex queue_mutex;
+    std::condition_variable queue_changed;
+    std::deque<Job> queue;
+    bool stopping;
+    std::thread worker;
 };
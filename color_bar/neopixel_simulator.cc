@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "neopixel_comms.hh"
+#include "neopixel_simulator.hh"
+
+using namespace neopixel_timing;
+
+namespace
+{
+
+//
+// A high pulse in between the longest 0 and the shortest 1 is read as whichever it's
+// closer to, but it still counts as a timing error
+//
+constexpr double ONE_THRESHOLD_NS = (ZERO_HIGH_MAX_NS + ONE_HIGH_MIN_NS) / 2.0;
+
+//
+// While nothing has been clocked out the line has been low forever
+//
+constexpr uint64_t IDLE_BITS = UINT64_MAX / 2;
+
+//
+// Round a number of bits to whole bits, the small fudge stops 4.0000001 from becoming 5
+//
+uint64_t bits_at_least(const double bits)
+{
+    return static_cast<uint64_t>(std::ceil(bits - 1E-6));
+}
+
+uint64_t bits_at_most(const double bits)
+{
+    return static_cast<uint64_t>(std::floor(bits + 1E-6));
+}
+
+//
+// How many argument bytes each command we know about takes. Anything not in here is
+// a bad command
+//
+bool command_argument_count(const BYTE command, size_t &count)
+{
+    switch (command)
+    {
+    case serial::mpsse::MSB_R_EDGE_OUT_BYTE:
+    case serial::mpsse::SET_D_BUS_DATA:
+    case serial::mpsse::SET_C_BUS_DATA:
+    case serial::mpsse::SET_TCK_DIVISOR:
+        count = 2;
+        return true;
+    case serial::mpsse::MSB_R_EDGE_OUT_BIT:
+        count = 1;
+        return true;
+    case serial::mpsse::GET_D_BUS_DATA:
+    case serial::mpsse::GET_C_BUS_DATA:
+    case serial::mpsse::LOOPBACK_ENABLE:
+    case serial::mpsse::LOOPBACK_DISABLE:
+    case serial::mpsse::CLOCK_60_MHZ:
+    case serial::mpsse::CLOCK_12_MHZ:
+    case serial::mpsse::THREE_PHASE_CLOCKING_ENABLE:
+    case serial::mpsse::THREE_PHASE_CLOCKING_DISABLE:
+    case serial::mpsse::ADAPTIVE_CLOCKING_ENABLE:
+    case serial::mpsse::ADAPTIVE_CLOCKING_DISABLE:
+        count = 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
+}
+
+//
+// ### constructor ############################################################
+//
+
+NeopixelSimulator::NeopixelSimulator(const double spi_clock_hz, const double reset_time_us)
+    : command(0),
+      arguments_needed(0),
+      argument_count(0),
+      data_remaining(0),
+      in_bit_command(false),
+      divide_by_5(false),
+      divisor(serial::SerialConnection::spi_clock_divisor(spi_clock_hz)),
+      clock_hz(0.0),
+      reset_time_ns(reset_time_us * 1E3),
+      level(false),
+      run_bits(IDLE_BITS),
+      bits_at_clock(0),
+      wire_time_base_ns(0.0),
+      pixel_bits(0),
+      pixel_bit_count(0),
+      frame_in_progress(false)
+{
+    set_clock(spi_clock_hz);
+}
+
+//
+// ### public methods #########################################################
+//
+
+FT_STATUS NeopixelSimulator::write(const BYTE *data, const size_t size, DWORD &bytes_written)
+{
+    simulator_stats.bytes += size;
+
+    size_t i = 0;
+    while (i < size)
+    {
+        //
+        // In the middle of a data command, clock out as much as we have
+        //
+        if (data_remaining > 0)
+        {
+            if (in_bit_command)
+            {
+                clock_out(&data[i], arguments[0] + 1);
+                data_remaining = 0;
+                ++i;
+            }
+            else
+            {
+                const size_t count = std::min(data_remaining, size - i);
+                clock_out(&data[i], count * 8);
+                data_remaining -= count;
+                i += count;
+            }
+            continue;
+        }
+
+        //
+        // Collecting arguments for a command
+        //
+        if (argument_count < arguments_needed)
+        {
+            arguments[argument_count++] = data[i++];
+            if (argument_count == arguments_needed)
+            {
+                run_command();
+            }
+            continue;
+        }
+
+        //
+        // Must be a new command then
+        //
+        command = data[i++];
+        argument_count = 0;
+        if (command_argument_count(command, arguments_needed) == false)
+        {
+            ++simulator_stats.bad_commands;
+            arguments_needed = 0;
+            continue;
+        }
+        if (arguments_needed == 0)
+        {
+            run_command();
+        }
+    }
+
+    //
+    // If the stream ended with a long enough low the strip latches right away, there's
+    // no need to wait for the next write to find out
+    //
+    if (level == false && run_bits >= reset_bits)
+    {
+        latch();
+    }
+
+    simulator_stats.wire_time_ns = wire_time_ns();
+    bytes_written = size;
+    return FT_OK;
+}
+
+//
+// ############################################################################
+//
+
+const std::vector<animations::Color> &NeopixelSimulator::last_frame() const
+{
+    return latched_frame;
+}
+
+//
+// ############################################################################
+//
+
+const NeopixelSimulator::Stats &NeopixelSimulator::stats() const
+{
+    return simulator_stats;
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelSimulator::set_frame_callback(const FrameCallback_t callback)
+{
+    frame_callback = callback;
+}
+
+//
+// ############################################################################
+//
+
+double NeopixelSimulator::spi_clock_hz() const
+{
+    return clock_hz;
+}
+
+//
+// ### private methods ########################################################
+//
+
+void NeopixelSimulator::clock_out(const BYTE *data, const size_t bit_count)
+{
+    //
+    // Instead of looking at every bit, grab 64 at a time and count how long the current
+    // level lasts with clz. That's one step per pulse instead of one per bit, which is
+    // what makes it fast enough for soak tests
+    //
+    for (size_t bit = 0; bit < bit_count; bit += 64)
+    {
+        const size_t bits_here = std::min<size_t>(64, bit_count - bit);
+        const BYTE *bytes = data + bit / 8;
+
+        uint64_t word = 0;
+        if (bits_here == 64)
+        {
+            std::memcpy(&word, bytes, sizeof(word));
+            word = __builtin_bswap64(word);
+        }
+        else
+        {
+            for (size_t k = 0; k < (bits_here + 7) / 8; ++k)
+            {
+                word |= static_cast<uint64_t>(bytes[k]) << (56 - 8 * k);
+            }
+        }
+        bits_at_clock += bits_here;
+
+        size_t bits_left = bits_here;
+        while (bits_left > 0)
+        {
+            //
+            // Leading zeros of this are how many bits stay at the current level
+            //
+            const uint64_t same_as_level = level ? ~word : word;
+            const size_t run = same_as_level == 0 ? 64 : __builtin_clzll(same_as_level);
+            if (run >= bits_left)
+            {
+                run_bits += bits_left;
+                break;
+            }
+
+            run_bits += run;
+            if (level)
+            {
+                falling_edge(run_bits);
+            }
+            else
+            {
+                rising_edge(run_bits);
+            }
+            level = !level;
+            run_bits = 0;
+
+            word <<= run;
+            bits_left -= run;
+        }
+    }
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelSimulator::falling_edge(const uint64_t high_bits)
+{
+    //
+    // A pulse that's too short, too long or stuck in between a 0 and a 1 is something
+    // the strip might get wrong
+    //
+    if (high_bits < zero_high_min_bits || high_bits > high_max_bits ||
+        (high_bits > zero_high_max_bits && high_bits < one_high_min_bits))
+    {
+        ++simulator_stats.timing_errors;
+    }
+
+    pixel_bits = (pixel_bits << 1) | (high_bits >= one_threshold_bits ? 1 : 0);
+    frame_in_progress = true;
+
+    //
+    // Colors come in GRB
+    //
+    if (++pixel_bit_count == 24)
+    {
+        current_frame.emplace_back((pixel_bits >> 8) & 0xFF, (pixel_bits >> 16) & 0xFF, pixel_bits & 0xFF);
+        pixel_bits = 0;
+        pixel_bit_count = 0;
+    }
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelSimulator::rising_edge(const uint64_t low_bits)
+{
+    if (low_bits >= reset_bits)
+    {
+        latch();
+        return;
+    }
+
+    if (frame_in_progress == false)
+    {
+        return;
+    }
+
+    if (low_bits > low_max_bits)
+    {
+        ++simulator_stats.latch_violations;
+    }
+    else if (low_bits < low_min_bits)
+    {
+        ++simulator_stats.timing_errors;
+    }
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelSimulator::latch()
+{
+    if (frame_in_progress == false)
+    {
+        return;
+    }
+
+    if (pixel_bit_count != 0)
+    {
+        ++simulator_stats.partial_pixels;
+    }
+    pixel_bits = 0;
+    pixel_bit_count = 0;
+    frame_in_progress = false;
+
+    //
+    // Swapping keeps the capacity of both around, so after the first frame there's
+    // no more allocating
+    //
+    latched_frame.swap(current_frame);
+    current_frame.clear();
+    ++simulator_stats.frames;
+
+    if (frame_callback)
+    {
+        frame_callback(latched_frame, wire_time_ns());
+    }
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelSimulator::run_command()
+{
+    switch (command)
+    {
+    case serial::mpsse::MSB_R_EDGE_OUT_BYTE:
+        data_remaining = (arguments[0] | (arguments[1] << 8)) + 1;
+        in_bit_command = false;
+        break;
+    case serial::mpsse::MSB_R_EDGE_OUT_BIT:
+        data_remaining = 1;
+        in_bit_command = true;
+        break;
+    case serial::mpsse::SET_TCK_DIVISOR:
+        divisor = arguments[0] | (arguments[1] << 8);
+        set_clock((divide_by_5 ? 12E6 : 60E6) / ((1.0 + divisor) * 2.0));
+        break;
+    case serial::mpsse::CLOCK_60_MHZ:
+        divide_by_5 = false;
+        set_clock(60E6 / ((1.0 + divisor) * 2.0));
+        break;
+    case serial::mpsse::CLOCK_12_MHZ:
+        divide_by_5 = true;
+        set_clock(12E6 / ((1.0 + divisor) * 2.0));
+        break;
+    default:
+        break;
+    }
+    arguments_needed = 0;
+    argument_count = 0;
+}
+
+//
+// ############################################################################
+//
+
+void NeopixelSimulator::set_clock(const double new_clock_hz)
+{
+    //
+    // Fold everything clocked so far into the base time before the clock changes
+    //
+    if (clock_hz > 0.0)
+    {
+        wire_time_base_ns += bits_at_clock * 1E9 / clock_hz;
+    }
+    bits_at_clock = 0;
+    clock_hz = new_clock_hz;
+
+    //
+    // Everything is compared in whole bits so the per pulse checks stay cheap
+    //
+    const double bits_per_ns = clock_hz / 1E9;
+    one_threshold_bits = bits_at_least(ONE_THRESHOLD_NS * bits_per_ns);
+    zero_high_min_bits = bits_at_least(ZERO_HIGH_MIN_NS * bits_per_ns);
+    zero_high_max_bits = bits_at_most(ZERO_HIGH_MAX_NS * bits_per_ns);
+    one_high_min_bits = bits_at_least(ONE_HIGH_MIN_NS * bits_per_ns);
+    high_max_bits = bits_at_most(ONE_HIGH_MAX_NS * bits_per_ns);
+    low_min_bits = bits_at_least(LOW_MIN_NS * bits_per_ns);
+    low_max_bits = bits_at_most(LOW_MAX_NS * bits_per_ns);
+    reset_bits = bits_at_least(reset_time_ns * bits_per_ns);
+}
+
+//
+// ############################################################################
+//
+
+uint64_t NeopixelSimulator::wire_time_ns() const
+{
+    return wire_time_base_ns + bits_at_clock * 1E9 / clock_hz;
+}
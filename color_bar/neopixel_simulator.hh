@@ -0,0 +1,171 @@
+#pragma once
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+#include "animations.hh"
+#include "../ftd2xx_driver/transport.hh"
+
+//
+// A fake strip of Neopixels that sits behind a SerialConnection (as its transport) and
+// decodes the MPSSE byte stream back into LED colors, the same way the strip would.
+//
+// It follows SET_TCK_DIVISOR and friends to know what the SPI clock is, measures every
+// high and low pulse against the Neopixel timing and counts anything that the real
+// strip would have choked on. Writes are treated as if they went out back to back on
+// the wire, so the only latch a frame gets is the one that's in the stream.
+//
+// This isn't thread safe, there should only ever be one thing writing to it
+//
+class NeopixelSimulator final : public serial::TransportBase
+{
+public: // types //////////////////////////////////////////////////////////////
+    struct Stats
+    {
+        //
+        // Frames that ended with a proper latch
+        //
+        uint64_t frames = 0;
+
+        //
+        // Bytes that came in and how long the SPI data in them took on the wire
+        //
+        uint64_t bytes = 0;
+        uint64_t wire_time_ns = 0;
+
+        //
+        // Commands we didn't recognize, the real MPSSE would have answered with BAD_COMMANDS
+        //
+        uint64_t bad_commands = 0;
+
+        //
+        // High pulses that aren't clearly a 0 or a 1, or low pulses that are too short
+        //
+        uint64_t timing_errors = 0;
+
+        //
+        // Low time that's too long to be part of a bit but too short to latch. The strip
+        // would do something undefined here, usually merge two frames
+        //
+        uint64_t latch_violations = 0;
+
+        //
+        // Frames that didn't end on a whole LED
+        //
+        uint64_t partial_pixels = 0;
+    };
+
+    //
+    // Called every time a frame latches with the colors and the simulated wire time
+    // (in nanoseconds) the latch happened at
+    //
+    using FrameCallback_t = std::function<void(const std::vector<animations::Color> &, uint64_t)>;
+
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // `spi_clock_hz` is only used until the stream sets its own clock.
+    // `reset_time_us` is how long the line needs to be low before the strip latches
+    //
+    NeopixelSimulator(const double spi_clock_hz = 5E6, const double reset_time_us = 280.0);
+
+public: // methods ////////////////////////////////////////////////////////////
+    FT_STATUS write(const BYTE *data, const size_t size, DWORD &bytes_written) override;
+
+    //
+    // The most recent frame that latched
+    //
+    const std::vector<animations::Color> &last_frame() const;
+
+    const Stats &stats() const;
+
+    void set_frame_callback(const FrameCallback_t callback);
+
+    //
+    // The clock the stream is running at right now
+    //
+    double spi_clock_hz() const;
+
+private: // methods ///////////////////////////////////////////////////////////
+    //
+    // Run the data pin through `bit_count` bits, MSB first, starting at `data`
+    //
+    void clock_out(const BYTE *data, const size_t bit_count);
+
+    //
+    // Called at every edge with how many SPI bits the previous level lasted
+    //
+    void falling_edge(const uint64_t high_bits);
+    void rising_edge(const uint64_t low_bits);
+
+    //
+    // Finish off the frame that's being built, if there is one
+    //
+    void latch();
+
+    //
+    // Handle a command once all of its arguments are in
+    //
+    void run_command();
+
+    //
+    // Recompute everything that depends on the clock
+    //
+    void set_clock(const double new_clock_hz);
+
+    //
+    // Simulated time on the wire so far
+    //
+    uint64_t wire_time_ns() const;
+
+private: // members ///////////////////////////////////////////////////////////
+    //
+    // Command parsing state, commands can be split across writes
+    //
+    BYTE command;
+    size_t arguments_needed;
+    size_t argument_count;
+    BYTE arguments[2];
+    size_t data_remaining;
+    bool in_bit_command;
+
+    //
+    // Clock state, the divisor is kept around in case the base clock changes after it
+    //
+    bool divide_by_5;
+    uint16_t divisor;
+    double clock_hz;
+
+    //
+    // Pulse thresholds converted into whole SPI bits for the current clock, the
+    // minimums are rounded up and the maximums rounded down
+    //
+    uint64_t one_threshold_bits;
+    uint64_t zero_high_min_bits;
+    uint64_t zero_high_max_bits;
+    uint64_t one_high_min_bits;
+    uint64_t high_max_bits;
+    uint64_t low_min_bits;
+    uint64_t low_max_bits;
+    uint64_t reset_bits;
+    double reset_time_ns;
+
+    //
+    // Data pin state
+    //
+    bool level;
+    uint64_t run_bits;
+    uint64_t bits_at_clock;
+    double wire_time_base_ns;
+
+    //
+    // The frame being decoded
+    //
+    uint32_t pixel_bits;
+    size_t pixel_bit_count;
+    bool frame_in_progress;
+    std::vector<animations::Color> current_frame;
+    std::vector<animations::Color> latched_frame;
+
+    Stats simulator_stats;
+    FrameCallback_t frame_callback;
+};
@@ -0,0 +1,328 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "opc_server.hh"
+
+namespace
+{
+
+constexpr auto RELAXED = std::memory_order_relaxed;
+
+constexpr size_t HEADER_SIZE = 4;
+constexpr uint8_t COMMAND_SET_PIXELS = 0;
+
+//
+// The length field is 16 bits, so this always fits a whole message, and the next read
+// always has at least this much room
+//
+constexpr size_t MAX_MESSAGE_SIZE = HEADER_SIZE + 0xFFFF;
+constexpr size_t MIN_READ_SIZE = 64 * 1024;
+
+constexpr size_t MAX_EVENTS = 64;
+
+//
+// epoll is level triggered, so a client with more to read comes back next pass. One
+// read per pass keeps a busy client from starving the rest, and keeps passes short so
+// the newest frame gets published soon after it arrives
+//
+constexpr size_t MAX_READS_PER_EVENT = 1;
+
+bool set_non_blocking(const int fd)
+{
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+}
+
+constexpr uint16_t OpcServer::DEFAULT_PORT;
+
+//
+// ### constructor ############################################################
+//
+
+OpcServer::OpcServer(LatestFrameOutput &output_, const uint16_t port, const std::string &address,
+                     const uint8_t channel_)
+    : output(output_),
+      channel(channel_),
+      listen_fd(-1),
+      epoll_fd(-1),
+      running(false),
+      frame(output_.led_count()),
+      frame_changed(false)
+{
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    epoll_fd = epoll_create1(0);
+    if (listen_fd < 0 || epoll_fd < 0)
+    {
+        std::cout << "ERROR: couldn't make the OPC socket" << std::endl;
+        return;
+    }
+
+    const int enable = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in bind_address;
+    std::memset(&bind_address, 0, sizeof(bind_address));
+    bind_address.sin_family = AF_INET;
+    bind_address.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &bind_address.sin_addr) != 1 ||
+        bind(listen_fd, reinterpret_cast<const sockaddr *>(&bind_address), sizeof(bind_address)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0 || set_non_blocking(listen_fd) == false)
+    {
+        std::cout << "ERROR: couldn't listen on " << address << ":" << port << std::endl;
+        close(listen_fd);
+        listen_fd = -1;
+        return;
+    }
+
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+}
+
+//
+// ############################################################################
+//
+
+OpcServer::~OpcServer()
+{
+    for (const auto &client : clients)
+    {
+        close(client.first);
+    }
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+    }
+    if (epoll_fd >= 0)
+    {
+        close(epoll_fd);
+    }
+}
+
+//
+// ### public methods #########################################################
+//
+
+bool OpcServer::is_open() const
+{
+    return listen_fd >= 0;
+}
+
+//
+// ############################################################################
+//
+
+size_t OpcServer::receive(const int timeout_ms)
+{
+    if (listen_fd < 0)
+    {
+        return 0;
+    }
+
+    epoll_event events[MAX_EVENTS];
+    const int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+    for (int i = 0; i < count; ++i)
+    {
+        const int fd = events[i].data.fd;
+        if (fd == listen_fd)
+        {
+            accept_clients();
+            continue;
+        }
+
+        auto client = clients.find(fd);
+        if (client == clients.end())
+        {
+            continue;
+        }
+        if ((events[i].events & (EPOLLERR | EPOLLHUP)) != 0 || read_client(fd, client->second) == false)
+        {
+            close_client(fd);
+        }
+    }
+
+    //
+    // However many messages came in, the output only needs the newest frame
+    //
+    if (frame_changed)
+    {
+        output.publish(frame.data(), frame.size());
+        counters.frames_published.fetch_add(1, RELAXED);
+        frame_changed = false;
+    }
+
+    return count > 0 ? count : 0;
+}
+
+//
+// ############################################################################
+//
+
+void OpcServer::run()
+{
+    running = true;
+    while (running)
+    {
+        receive(5);
+    }
+}
+
+//
+// ############################################################################
+//
+
+void OpcServer::stop()
+{
+    running = false;
+}
+
+//
+// ############################################################################
+//
+
+OpcServer::Stats OpcServer::stats() const
+{
+    Stats s;
+    s.connections = counters.connections.load(RELAXED);
+    s.clients = counters.clients.load(RELAXED);
+    s.bytes = counters.bytes.load(RELAXED);
+    s.messages = counters.messages.load(RELAXED);
+    s.ignored_messages = counters.ignored_messages.load(RELAXED);
+    s.frames_published = counters.frames_published.load(RELAXED);
+    return s;
+}
+
+//
+// ### private methods ########################################################
+//
+
+void OpcServer::accept_clients()
+{
+    while (true)
+    {
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        //
+        // Small frames shouldn't sit around waiting for Nagle
+        //
+        const int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        set_non_blocking(fd);
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            close(fd);
+            continue;
+        }
+
+        Client &client = clients[fd];
+        client.buffer.resize(MAX_MESSAGE_SIZE + MIN_READ_SIZE);
+        counters.connections.fetch_add(1, RELAXED);
+        counters.clients.store(clients.size(), RELAXED);
+    }
+}
+
+//
+// ############################################################################
+//
+
+bool OpcServer::read_client(const int fd, Client &client)
+{
+    for (size_t reads = 0; reads < MAX_READS_PER_EVENT; ++reads)
+    {
+        const ssize_t received = recv(fd, &client.buffer[client.used], client.buffer.size() - client.used, 0);
+        if (received == 0)
+        {
+            return false;
+        }
+        if (received < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        counters.bytes.fetch_add(received, RELAXED);
+        client.used += received;
+
+        //
+        // Handle every whole message that's in the buffer
+        //
+        size_t offset = 0;
+        while (client.used - offset >= HEADER_SIZE)
+        {
+            const uint8_t *header = &client.buffer[offset];
+            const size_t length = (static_cast<size_t>(header[2]) << 8) | header[3];
+            if (client.used - offset < HEADER_SIZE + length)
+            {
+                break;
+            }
+            handle_message(header[0], header[1], header + HEADER_SIZE, length);
+            offset += HEADER_SIZE + length;
+        }
+
+        //
+        // Slide whatever's left of a partial message back to the front. That's never
+        // more than one message, so there's always room for the next read
+        //
+        if (offset > 0)
+        {
+            std::memmove(&client.buffer[0], &client.buffer[offset], client.used - offset);
+            client.used -= offset;
+        }
+    }
+    return true;
+}
+
+//
+// ############################################################################
+//
+
+void OpcServer::handle_message(const uint8_t message_channel, const uint8_t command, const uint8_t *data,
+                               const size_t size)
+{
+    counters.messages.fetch_add(1, RELAXED);
+    if (command != COMMAND_SET_PIXELS || (channel != 0 && message_channel != 0 && message_channel != channel))
+    {
+        counters.ignored_messages.fetch_add(1, RELAXED);
+        return;
+    }
+
+    const size_t count = std::min(size / 3, frame.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        frame[i].R = data[0];
+        frame[i].G = data[1];
+        frame[i].B = data[2];
+        data += 3;
+    }
+    frame_changed = true;
+}
+
+//
+// ############################################################################
+//
+
+void OpcServer::close_client(const int fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    clients.erase(fd);
+    counters.clients.store(clients.size(), RELAXED);
+}
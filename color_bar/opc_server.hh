@@ -0,0 +1,120 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "animations.hh"
+#include "frame_output.hh"
+
+//
+// Open Pixel Control (http://openpixelcontrol.org) server. Any number of clients can
+// connect over TCP and send "set pixel colors" messages, all of them are handled by one
+// epoll loop on whichever thread calls run().
+//
+// Each client's bytes are read into that client's buffer (which keeps its size between
+// reads) and whole messages are decoded right out of it into one shared frame. Every
+// pass of the loop that changed the frame publishes it once to a LatestFrameOutput, so
+// several clients sending at 60Hz turn into at most one frame per pass and the output
+// always gets the newest one.
+//
+// A message with fewer pixels than the strip only changes the first LEDs, as many as
+// it has pixels, and leaves the rest alone. OPC pixels always start at LED 0, so a
+// client can't own a later stretch of the strip. Two clients sending short messages
+// both write from the start and the last one wins
+//
+class OpcServer
+{
+public: // types //////////////////////////////////////////////////////////////
+    struct Stats
+    {
+        uint64_t connections = 0;
+        uint64_t clients = 0;
+        uint64_t bytes = 0;
+        uint64_t messages = 0;
+
+        //
+        // Other commands, or messages for a channel we aren't
+        //
+        uint64_t ignored_messages = 0;
+        uint64_t frames_published = 0;
+    };
+
+public: // constants //////////////////////////////////////////////////////////
+    static constexpr uint16_t DEFAULT_PORT = 7890;
+
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // Starts listening right away, check is_open(). Messages to channel 0 (everyone)
+    // or to `channel` are used, a `channel` of 0 takes every channel
+    //
+    OpcServer(LatestFrameOutput &output_,
+              const uint16_t port = DEFAULT_PORT,
+              const std::string &address = "0.0.0.0",
+              const uint8_t channel_ = 0);
+
+    ~OpcServer();
+
+public: // methods ////////////////////////////////////////////////////////////
+    bool is_open() const;
+
+    //
+    // Wait up to `timeout_ms` for something to happen and handle it. Returns how many
+    // events were handled
+    //
+    size_t receive(const int timeout_ms);
+
+    //
+    // Keep receiving until stop() is called (from any thread)
+    //
+    void run();
+    void stop();
+
+    Stats stats() const;
+
+private: // types /////////////////////////////////////////////////////////////
+    struct Client
+    {
+        //
+        // Bytes read but not handled yet, the front of this is always the start of a
+        // message
+        //
+        std::vector<uint8_t> buffer;
+        size_t used = 0;
+    };
+
+private: // methods ///////////////////////////////////////////////////////////
+    void accept_clients();
+
+    //
+    // Read everything the client has for us, returns false if it went away
+    //
+    bool read_client(const int fd, Client &client);
+
+    void handle_message(const uint8_t channel, const uint8_t command, const uint8_t *data, const size_t size);
+
+    void close_client(const int fd);
+
+private: // members ///////////////////////////////////////////////////////////
+    LatestFrameOutput &output;
+    uint8_t channel;
+    int listen_fd;
+    int epoll_fd;
+    std::atomic<bool> running;
+
+    std::unordered_map<int, Client> clients;
+    std::vector<animations::Color> frame;
+    bool frame_changed;
+
+    struct AtomicStats
+    {
+        std::atomic<uint64_t> connections{0};
+        std::atomic<uint64_t> clients{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> messages{0};
+        std::atomic<uint64_t> ignored_messages{0};
+        std::atomic<uint64_t> frames_published{0};
+    };
+    AtomicStats counters;
+};
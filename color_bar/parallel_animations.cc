@@ -0,0 +1,159 @@
+#include <iostream>
+
+#include "parallel_animations.hh"
+
+namespace animations
+{
+
+namespace
+{
+
+//
+// Get `sequence` to hold `frame_count` frames of `led_count` LEDs
+//
+void size_sequence(FrameSequence &sequence, const size_t led_count, const size_t frame_count)
+{
+    if (sequence.led_count() != led_count)
+    {
+        sequence = FrameSequence(led_count);
+    }
+    sequence.resize(frame_count);
+}
+
+bool same_led_count(const Frame &frame_start, const Frame &frame_end)
+{
+    if (frame_start.colors.size() != frame_end.colors.size())
+    {
+        std::cout << "ERROR: can't fade between frames with different LED counts" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+//
+// ############################################################################
+//
+
+void green_percent_bar_ramp_into(ThreadPool &pool,
+                                 const double percent_start,
+                                 const double percent_end,
+                                 const size_t led_count,
+                                 const unsigned long duration_ms,
+                                 const size_t step_count,
+                                 std::vector<Frame> &frames)
+{
+    const size_t steps = ramp_steps(step_count);
+    frames.resize(steps + 1);
+    pool.parallel_for(frames.size(),
+                      [&](const size_t begin, const size_t end)
+                      {
+                          for (size_t i = begin; i < end; ++i)
+                          {
+                              green_percent_bar_into(percent_step(percent_start, percent_end, steps, i),
+                                                     led_count, frames[i]);
+                              frames[i].hold_time_ms = duration_ms / steps;
+                          }
+                      });
+}
+
+//
+// ############################################################################
+//
+
+bool fade_into(ThreadPool &pool,
+               const Frame &frame_start,
+               const Frame &frame_end,
+               const double duration_ms,
+               const size_t step_count,
+               std::vector<Frame> &frames)
+{
+    if (same_led_count(frame_start, frame_end) == false)
+    {
+        frames.clear();
+        return false;
+    }
+
+    const size_t led_count = frame_start.colors.size();
+    const size_t steps = ramp_steps(step_count);
+    const unsigned long hold_time_ms = static_cast<unsigned long>(duration_ms / steps);
+
+    frames.resize(steps + 1);
+    pool.parallel_for(frames.size(),
+                      [&](const size_t begin, const size_t end)
+                      {
+                          for (size_t i = begin; i < end; ++i)
+                          {
+                              Frame &f = frames[i];
+                              f.colors.resize(led_count);
+                              f.hold_time_ms = hold_time_ms;
+                              fade_colors(frame_start.colors.data(), frame_end.colors.data(), led_count,
+                                          static_cast<double>(i) / steps, f.colors.data());
+                          }
+                      });
+    return true;
+}
+
+//
+// ############################################################################
+//
+
+void green_percent_bar_ramp_into(ThreadPool &pool,
+                                 const double percent_start,
+                                 const double percent_end,
+                                 const size_t led_count,
+                                 const unsigned long duration_ms,
+                                 const size_t step_count,
+                                 FrameSequence &sequence)
+{
+    const size_t steps = ramp_steps(step_count);
+    size_sequence(sequence, led_count, steps + 1);
+    pool.parallel_for(steps + 1,
+                      [&](const size_t begin, const size_t end)
+                      {
+                          for (size_t i = begin; i < end; ++i)
+                          {
+                              green_percent_bar_colors(percent_step(percent_start, percent_end, steps, i),
+                                                       led_count, sequence.frame_data(i));
+                              sequence.set_hold_time_ms(i, duration_ms / steps);
+                          }
+                      });
+}
+
+//
+// ############################################################################
+//
+
+bool fade_into(ThreadPool &pool,
+               const Frame &frame_start,
+               const Frame &frame_end,
+               const double duration_ms,
+               const size_t step_count,
+               FrameSequence &sequence)
+{
+    if (same_led_count(frame_start, frame_end) == false)
+    {
+        sequence.resize(0);
+        return false;
+    }
+
+    const size_t led_count = frame_start.colors.size();
+    const size_t steps = ramp_steps(step_count);
+    const unsigned long hold_time_ms = static_cast<unsigned long>(duration_ms / steps);
+
+    size_sequence(sequence, led_count, steps + 1);
+    pool.parallel_for(steps + 1,
+                      [&](const size_t begin, const size_t end)
+                      {
+                          for (size_t i = begin; i < end; ++i)
+                          {
+                              fade_colors(frame_start.colors.data(), frame_end.colors.data(), led_count,
+                                          static_cast<double>(i) / steps, sequence.frame_data(i));
+                              sequence.set_hold_time_ms(i, hold_time_ms);
+                          }
+                      });
+    return true;
+}
+
+} // namespace animations
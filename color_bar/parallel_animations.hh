@@ -0,0 +1,54 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+#include "animations.hh"
+#include "frame_sequence.hh"
+#include "thread_pool.hh"
+
+namespace animations
+{
+
+//
+// The same animations as animations.hh, but with the frames split up across a
+// ThreadPool. Every frame is worked out on its own so the result is exactly what the
+// single threaded versions make. These are for precomputing long shows, anything short
+// enough to fit in a frame or two isn't worth handing to other threads
+//
+
+void green_percent_bar_ramp_into(ThreadPool &pool,
+                                 const double percent_start,
+                                 const double percent_end,
+                                 const size_t led_count,
+                                 const unsigned long duration_ms,
+                                 const size_t step_count,
+                                 std::vector<Frame> &frames);
+
+bool fade_into(ThreadPool &pool,
+               const Frame &frame_start,
+               const Frame &frame_end,
+               const double duration_ms,
+               const size_t step_count,
+               std::vector<Frame> &frames);
+
+//
+// Straight into a FrameSequence, which is one block of memory for the whole show so
+// there's nothing to allocate per frame. The sequence is resized to fit (and remade if
+// it has a different LED count)
+//
+void green_percent_bar_ramp_into(ThreadPool &pool,
+                                 const double percent_start,
+                                 const double percent_end,
+                                 const size_t led_count,
+                                 const unsigned long duration_ms,
+                                 const size_t step_count,
+                                 FrameSequence &sequence);
+
+bool fade_into(ThreadPool &pool,
+               const Frame &frame_start,
+               const Frame &frame_end,
+               const double duration_ms,
+               const size_t step_count,
+               FrameSequence &sequence);
+
+} // namespace animations
@@ -0,0 +1,327 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include "shm_channel.hh"
+#include "../ftd2xx_driver/metrics.hh"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+//
+// Slots are a SlotHeader then the data, rounded up to whole cache lines
+//
+size_t slot_stride(const size_t slot_capacity)
+{
+    const size_t size = sizeof(shm::SlotHeader) + slot_capacity;
+    return (size + shm::CACHE_LINE - 1) / shm::CACHE_LINE * shm::CACHE_LINE;
+}
+
+shm::SlotHeader *slot_at(uint8_t *mapping, const shm::SegmentHeader *header, const uint64_t slot)
+{
+    return reinterpret_cast<shm::SlotHeader *>(mapping + sizeof(shm::SegmentHeader) +
+                                               slot * slot_stride(header->slot_capacity));
+}
+
+//
+// Let the other hyperthread have the core for a moment while spinning
+//
+inline void cpu_relax()
+{
+#ifdef __SSE2__
+    _mm_pause();
+#endif
+}
+
+//
+// How many times a read retries before it gives up on a slot. It only ever has to retry
+// if the producer lapped the whole ring while we were copying
+//
+constexpr size_t MAX_READ_ATTEMPTS = 16;
+
+//
+// Spin this many times without giving the core away
+//
+constexpr size_t SPINS_BEFORE_YIELD = 4096;
+
+}
+
+//
+// ### ShmFrameWriter #########################################################
+//
+
+ShmFrameWriter::ShmFrameWriter(const std::string &name_, const shm::Format format, const size_t slot_capacity,
+                               const size_t slot_count)
+    : name(name_), fd(-1), mapping(nullptr), mapped_size(0), header(nullptr), published(0)
+{
+    //
+    // Frames go round the slots, so there has to be at least one (and the count has to
+    // fit in the header)
+    //
+    if (slot_count == 0 || slot_count > UINT32_MAX)
+    {
+        std::cout << "ERROR: shared memory " << name << " can't have " << slot_count << " slots" << std::endl;
+        return;
+    }
+
+    mapped_size = sizeof(shm::SegmentHeader) + slot_count * slot_stride(slot_capacity);
+
+    //
+    // Start from nothing so a reader never sees a half set up segment with old data
+    //
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || ftruncate(fd, mapped_size) != 0)
+    {
+        std::cout << "ERROR: couldn't make shared memory " << name << std::endl;
+        return;
+    }
+
+    void *new_mapping = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (new_mapping == MAP_FAILED)
+    {
+        std::cout << "ERROR: couldn't map shared memory " << name << std::endl;
+        return;
+    }
+    mapping = static_cast<uint8_t *>(new_mapping);
+
+    //
+    // ftruncate zeroed everything, so every sequence starts at 0 (even, nothing being
+    // written). The magic goes in last so readers don't see the segment until it's ready
+    //
+    header = new (mapping) shm::SegmentHeader;
+    header->format = format;
+    header->slot_count = slot_count;
+    header->slot_capacity = slot_capacity;
+    header->latest.store(0, std::memory_order_relaxed);
+    for (size_t slot = 0; slot < slot_count; ++slot)
+    {
+        new (slot_at(mapping, header, slot)) shm::SlotHeader;
+        slot_at(mapping, header, slot)->sequence.store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, shm::MAGIC, sizeof(shm::MAGIC));
+}
+
+//
+// ############################################################################
+//
+
+ShmFrameWriter::~ShmFrameWriter()
+{
+    if (mapping != nullptr)
+    {
+        munmap(mapping, mapped_size);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+        shm_unlink(name.c_str());
+    }
+}
+
+//
+// ############################################################################
+//
+
+bool ShmFrameWriter::is_open() const
+{
+    return mapping != nullptr;
+}
+
+//
+// ############################################################################
+//
+
+bool ShmFrameWriter::publish(const void *data, const size_t size)
+{
+    if (mapping == nullptr || size > header->slot_capacity)
+    {
+        std::cout << "ERROR: can't publish a " << size << " byte frame" << std::endl;
+        return false;
+    }
+
+    const uint64_t frame_number = published + 1;
+    shm::SlotHeader *slot = slot_at(mapping, header, published % header->slot_count);
+
+    //
+    // Odd while we're writing, the fence keeps the data writes from moving above it
+    //
+    const uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->frame_number = frame_number;
+    slot->timestamp_ns = serial::now_ns();
+    slot->size = size;
+    std::memcpy(reinterpret_cast<uint8_t *>(slot) + sizeof(shm::SlotHeader), data, size);
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    header->latest.store(frame_number, std::memory_order_release);
+    published = frame_number;
+    return true;
+}
+
+//
+// ### ShmFrameReader #########################################################
+//
+
+ShmFrameReader::ShmFrameReader(const std::string &name)
+    : fd(-1), mapping(nullptr), mapped_size(0), header(nullptr), last_read(0)
+{
+    fd = shm_open(name.c_str(), O_RDWR, 0);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(shm::SegmentHeader))
+    {
+        std::cout << "ERROR: couldn't open shared memory " << name << std::endl;
+        return;
+    }
+    mapped_size = info.st_size;
+
+    //
+    // Writable because the sequence numbers are atomics, even though we only ever load
+    // them
+    //
+    void *new_mapping = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (new_mapping == MAP_FAILED)
+    {
+        std::cout << "ERROR: couldn't map shared memory " << name << std::endl;
+        return;
+    }
+
+    header = static_cast<shm::SegmentHeader *>(new_mapping);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (std::memcmp(header->magic, shm::MAGIC, sizeof(shm::MAGIC)) != 0 || header->slot_count == 0 ||
+        sizeof(shm::SegmentHeader) + header->slot_count * slot_stride(header->slot_capacity) > mapped_size)
+    {
+        std::cout << "ERROR: " << name << " isn't a frame channel" << std::endl;
+        munmap(new_mapping, mapped_size);
+        header = nullptr;
+        return;
+    }
+    mapping = static_cast<uint8_t *>(new_mapping);
+}
+
+//
+// ############################################################################
+//
+
+ShmFrameReader::~ShmFrameReader()
+{
+    if (mapping != nullptr)
+    {
+        munmap(mapping, mapped_size);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+//
+// ############################################################################
+//
+
+bool ShmFrameReader::is_open() const
+{
+    return mapping != nullptr;
+}
+
+//
+// ############################################################################
+//
+
+shm::Format ShmFrameReader::format() const
+{
+    return header != nullptr ? header->format : shm::Format::PIXELS;
+}
+
+//
+// ############################################################################
+//
+
+bool ShmFrameReader::read_latest(std::vector<uint8_t> &frame, ShmFrameInfo &info)
+{
+    if (mapping == nullptr)
+    {
+        return false;
+    }
+
+    for (size_t attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt)
+    {
+        const uint64_t latest = header->latest.load(std::memory_order_acquire);
+        if (latest == last_read)
+        {
+            return false;
+        }
+
+        const shm::SlotHeader *slot = slot_at(mapping, header, (latest - 1) % header->slot_count);
+        const uint64_t before = slot->sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0)
+        {
+            cpu_relax();
+            continue;
+        }
+
+        const uint64_t size = slot->size;
+        if (size > header->slot_capacity)
+        {
+            continue;
+        }
+        frame.resize(size);
+        std::memcpy(frame.data(), reinterpret_cast<const uint8_t *>(slot) + sizeof(shm::SlotHeader), size);
+        info.frame_number = slot->frame_number;
+        info.timestamp_ns = slot->timestamp_ns;
+
+        //
+        // If the sequence moved the producer came around and wrote over the slot while
+        // we were copying it, so try again with whatever the newest frame is now
+        //
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) == before)
+        {
+            last_read = info.frame_number;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// ############################################################################
+//
+
+bool ShmFrameReader::wait_for_frame(const uint64_t timeout_us) const
+{
+    if (mapping == nullptr)
+    {
+        return false;
+    }
+
+    const uint64_t deadline_ns = serial::now_ns() + timeout_us * 1000;
+    size_t spins = 0;
+    while (header->latest.load(std::memory_order_acquire) == last_read)
+    {
+        if (++spins < SPINS_BEFORE_YIELD)
+        {
+            cpu_relax();
+            continue;
+        }
+
+        if (serial::now_ns() >= deadline_ns)
+        {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
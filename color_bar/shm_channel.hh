@@ -0,0 +1,162 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//
+// Frames passed between processes on the same box through POSIX shared memory. A
+// producer maps the segment and writes frames into a small ring of slots, the driver
+// maps the same segment and picks the newest frame up. Neither side makes a syscall
+// per frame, it's all memcpy and a few atomics.
+//
+// Each slot is a seqlock: the producer bumps the slot's sequence to odd, writes, then
+// bumps it to even. A reader copies the slot out and only trusts the copy if the
+// sequence was the same even number before and after. With a few slots in the ring the
+// producer is almost never writing the slot that's being read, so readers hardly ever
+// have to retry, and the producer never waits on a reader.
+//
+// Everything is native endian and the atomics have to be lock free, so both processes
+// need to be on the same machine (which is the point)
+//
+namespace shm
+{
+
+constexpr char MAGIC[8] = {'C', 'B', 'S', 'H', 'M', '0', '0', '1'};
+
+//
+// What's in the slots. PIXELS is animations::Color (RGBA bytes) per LED, the reader
+// encodes them. WIRE is already encoded by the producer (NeopixelComms::build_frame,
+// latch included) so the reader just sends it
+//
+enum class Format : uint32_t
+{
+    PIXELS = 0,
+    WIRE = 1
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory frames need lock free 64 bit atomics");
+
+//
+// Every part starts on its own cache line so the producer and readers don't fight over
+// lines they aren't using
+//
+constexpr size_t CACHE_LINE = 64;
+
+struct alignas(CACHE_LINE) SegmentHeader
+{
+    char magic[8];
+    Format format;
+    uint32_t slot_count;
+    uint64_t slot_capacity;
+
+    //
+    // Frames published so far, the newest is in slot (latest - 1) % slot_count. 0 means
+    // there hasn't been one yet
+    //
+    alignas(CACHE_LINE) std::atomic<uint64_t> latest;
+};
+
+struct alignas(CACHE_LINE) SlotHeader
+{
+    std::atomic<uint64_t> sequence;
+    uint64_t frame_number;
+    uint64_t timestamp_ns;
+    uint64_t size;
+};
+
+} // namespace shm
+
+//
+// Information about a frame that was read
+//
+struct ShmFrameInfo
+{
+    uint64_t frame_number = 0;
+
+    //
+    // Steady clock time the producer started publishing it
+    //
+    uint64_t timestamp_ns = 0;
+};
+
+//
+// The producer side, it creates the segment (replacing one with the same name) and
+// removes the name again when it goes away
+//
+class ShmFrameWriter
+{
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // `name` is a POSIX shm name like "/color_bar". `slot_capacity` is the biggest frame
+    // in bytes, and there has to be at least one slot. Check is_open()
+    //
+    ShmFrameWriter(const std::string &name_, const shm::Format format, const size_t slot_capacity,
+                   const size_t slot_count = 4);
+
+    ~ShmFrameWriter();
+
+    ShmFrameWriter(const ShmFrameWriter &) = delete;
+    ShmFrameWriter &operator=(const ShmFrameWriter &) = delete;
+
+public: // methods ////////////////////////////////////////////////////////////
+    bool is_open() const;
+
+    //
+    // Write a frame into the next slot and make it the latest. Only one thread (in one
+    // process) should be publishing
+    //
+    bool publish(const void *data, const size_t size);
+
+private: // members ///////////////////////////////////////////////////////////
+    std::string name;
+    int fd;
+    uint8_t *mapping;
+    size_t mapped_size;
+    shm::SegmentHeader *header;
+    uint64_t published;
+};
+
+//
+// The consumer side, any number of these can read the same segment
+//
+class ShmFrameReader
+{
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // Opens a segment a writer already made
+    //
+    ShmFrameReader(const std::string &name);
+
+    ~ShmFrameReader();
+
+    ShmFrameReader(const ShmFrameReader &) = delete;
+    ShmFrameReader &operator=(const ShmFrameReader &) = delete;
+
+public: // methods ////////////////////////////////////////////////////////////
+    bool is_open() const;
+
+    shm::Format format() const;
+
+    //
+    // Copy the newest frame into `frame` if it's one we haven't read yet. Returns false
+    // if there's nothing new. `frame` keeps its capacity, so a reused vector doesn't
+    // allocate
+    //
+    bool read_latest(std::vector<uint8_t> &frame, ShmFrameInfo &info);
+
+    //
+    // Spin until there's a frame we haven't read, or `timeout_us` goes by. This burns a
+    // core on purpose, that's what keeps the latency down. After a while of nothing it
+    // starts giving the core away between checks
+    //
+    bool wait_for_frame(const uint64_t timeout_us) const;
+
+private: // members ///////////////////////////////////////////////////////////
+    int fd;
+    uint8_t *mapping;
+    size_t mapped_size;
+    shm::SegmentHeader *header;
+    uint64_t last_read;
+};
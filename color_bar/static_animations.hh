@@ -0,0 +1,177 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "animations.hh"
+#include "neopixel_comms.hh"
+
+//
+// Animations for a fixed number of LEDs worked out entirely at compile time. Declare a
+// table constexpr and it ends up in the binary's read only data, so a small host with
+// a strip that never changes length doesn't spend anything making frames at startup or
+// while it's running. Tables can hold colors, or frames already encoded for a clock
+// so playing them is nothing but writing bytes:
+//
+//     constexpr auto METER = animations::static_green_percent_bar_ramp<144, 20>(0.0, 1.0);
+//     using Encoding = animations::StaticEncoding<3>;  // SPI divisor 3 is 7.5MHz
+//     constexpr auto METER_WIRE = animations::static_encode_all<Encoding>(METER);
+//
+//     serial.configure_spi_defaults(Encoding::spi_clock_hz);
+//     serial.spi_write_data(METER_WIRE[level].data(), METER_WIRE[level].size(), packet);
+//
+// The frames come out exactly the same as green_percent_bar_ramp and NeopixelComms
+// make them at run time, without any color correction or power limiting. Big tables
+// can take the compiler a while, -fconstexpr-loop-limit and -fconstexpr-ops-limit may
+// need raising for long strips
+//
+namespace animations
+{
+
+//
+// std::array can't be written to in a constexpr function until C++17, so this is
+// just enough of one that can
+//
+template <typename T, size_t N>
+struct StaticArray
+{
+    T values[N];
+
+    constexpr T &operator[](const size_t index)
+    {
+        return values[index];
+    }
+
+    constexpr const T &operator[](const size_t index) const
+    {
+        return values[index];
+    }
+
+    constexpr const T *data() const
+    {
+        return values;
+    }
+
+    static constexpr size_t size()
+    {
+        return N;
+    }
+};
+
+template <size_t LED_COUNT>
+using StaticFrame = StaticArray<Color, LED_COUNT>;
+
+//
+// Same as green_percent_bar
+//
+template <size_t LED_COUNT>
+constexpr StaticFrame<LED_COUNT> static_green_percent_bar(const double percent)
+{
+    StaticFrame<LED_COUNT> frame{};
+    const size_t green_pixels = green_pixel_count(percent, LED_COUNT);
+    for (size_t i = 0; i < LED_COUNT; ++i)
+    {
+        frame[i] = i < green_pixels ? GREEN : RED;
+    }
+    return frame;
+}
+
+//
+// Same as green_percent_bar_ramp, `STEP_COUNT + 1` frames. Nothing in here has a hold
+// time, whoever plays them picks the rate
+//
+template <size_t LED_COUNT, size_t STEP_COUNT>
+constexpr StaticArray<StaticFrame<LED_COUNT>, STEP_COUNT + 1> static_green_percent_bar_ramp(const double percent_start,
+                                                                                            const double percent_end)
+{
+    StaticArray<StaticFrame<LED_COUNT>, STEP_COUNT + 1> frames{};
+    for (size_t i = 0; i <= STEP_COUNT; ++i)
+    {
+        frames[i] = static_green_percent_bar<LED_COUNT>(percent_step(percent_start, percent_end, STEP_COUNT, i));
+    }
+    return frames;
+}
+
+//
+// The encoding for one SPI clock, given as the MPSSE divisor since that's what the
+// clock really is (see SerialConnection::spi_clock_divisor). It's a compile error if
+// the clock can't make the Neopixel timing
+//
+template <uint16_t DIVISOR, size_t LATCH_TIME_US = 300>
+struct StaticEncoding
+{
+    static constexpr double spi_clock_hz = serial::SerialConnection::spi_clock_hz_for_divisor(DIVISOR);
+    static constexpr neopixel_timing::Symbols symbols = neopixel_timing::symbols_for_clock(spi_clock_hz);
+    static constexpr size_t latch_bytes = neopixel_timing::latch_bytes_for(LATCH_TIME_US, spi_clock_hz);
+
+    static_assert(symbols.symbol_bits > 0, "This SPI clock can't make the Neopixel timing");
+
+    //
+    // Encoded size of a frame, latch included
+    //
+    static constexpr size_t frame_bytes(const size_t led_count)
+    {
+        return led_count * 3 * symbols.symbol_bits + latch_bytes;
+    }
+};
+
+template <uint16_t DIVISOR, size_t LATCH_TIME_US>
+constexpr double StaticEncoding<DIVISOR, LATCH_TIME_US>::spi_clock_hz;
+template <uint16_t DIVISOR, size_t LATCH_TIME_US>
+constexpr neopixel_timing::Symbols StaticEncoding<DIVISOR, LATCH_TIME_US>::symbols;
+template <uint16_t DIVISOR, size_t LATCH_TIME_US>
+constexpr size_t StaticEncoding<DIVISOR, LATCH_TIME_US>::latch_bytes;
+
+//
+// Write the symbols for one color byte, MSB first, starting at `offset`
+//
+template <typename Encoding, size_t N>
+constexpr void static_encode_byte(const uchar_t byte, StaticArray<uint8_t, N> &out, const size_t offset)
+{
+    constexpr neopixel_timing::Symbols symbols = Encoding::symbols;
+    for (size_t bit = 0; bit < 8; ++bit)
+    {
+        const bool one = (byte & (0x80 >> bit)) != 0;
+        const size_t high_bits = one ? symbols.one_high_bits : symbols.zero_high_bits;
+        for (size_t j = 0; j < high_bits; ++j)
+        {
+            const size_t index = bit * symbols.symbol_bits + j;
+            out[offset + index / 8] |= 0x80 >> (index % 8);
+        }
+    }
+}
+
+//
+// A frame encoded the way NeopixelComms::build_frame does it, GRB with the latch on the
+// end. This is the data for spi_write_data
+//
+template <typename Encoding, size_t LED_COUNT>
+constexpr StaticArray<uint8_t, Encoding::frame_bytes(LED_COUNT)> static_encode(const StaticFrame<LED_COUNT> &frame)
+{
+    constexpr size_t symbol_bits = Encoding::symbols.symbol_bits;
+    StaticArray<uint8_t, Encoding::frame_bytes(LED_COUNT)> out{};
+    for (size_t i = 0; i < LED_COUNT; ++i)
+    {
+        const size_t offset = i * 3 * symbol_bits;
+        static_encode_byte<Encoding>(frame[i].G, out, offset);
+        static_encode_byte<Encoding>(frame[i].R, out, offset + symbol_bits);
+        static_encode_byte<Encoding>(frame[i].B, out, offset + 2 * symbol_bits);
+    }
+    return out;
+}
+
+//
+// Every frame of a table encoded
+//
+template <typename Encoding, size_t LED_COUNT, size_t FRAME_COUNT>
+constexpr StaticArray<StaticArray<uint8_t, Encoding::frame_bytes(LED_COUNT)>, FRAME_COUNT>
+static_encode_all(const StaticArray<StaticFrame<LED_COUNT>, FRAME_COUNT> &frames)
+{
+    StaticArray<StaticArray<uint8_t, Encoding::frame_bytes(LED_COUNT)>, FRAME_COUNT> encoded{};
+    for (size_t i = 0; i < FRAME_COUNT; ++i)
+    {
+        encoded[i] = static_encode<Encoding>(frames[i]);
+    }
+    return encoded;
+}
+
+} // namespace animations
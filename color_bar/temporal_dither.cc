@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <iostream>
+
+#include "temporal_dither.hh"
+
+namespace
+{
+
+//
+// Add the leftover to a 16 bit value and round it down to 8 bits, keeping the new
+// leftover. Anything that ends up past full brightness can't be shown, so that just
+// gets dropped
+//
+inline uint8_t quantize(const uint16_t value, uint8_t &error)
+{
+    const uint32_t total = static_cast<uint32_t>(value) + error;
+    if (total >= 0xFF00)
+    {
+        error = 0;
+        return 0xFF;
+    }
+    error = total & 0xFF;
+    return total >> 8;
+}
+
+}
+
+//
+// ### constructor ############################################################
+//
+
+TemporalDither::TemporalDither(const size_t led_count_)
+    : led_count(led_count_), error(3 * led_count_), quantized(led_count_)
+{
+    reset();
+}
+
+//
+// ### public methods #########################################################
+//
+
+const std::vector<animations::Color> &TemporalDither::dither(const std::vector<Color16> &colors)
+{
+    if (colors.size() != led_count)
+    {
+        std::cout << "ERROR: dithering " << colors.size() << " colors for " << led_count << " LEDs" << std::endl;
+    }
+
+    const size_t count = std::min(colors.size(), led_count);
+    uint8_t *leftover = error.data();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Color16 color = colors[i];
+        animations::Color &out = quantized[i];
+        out.R = quantize(color.R, leftover[0]);
+        out.G = quantize(color.G, leftover[1]);
+        out.B = quantize(color.B, leftover[2]);
+        leftover += 3;
+    }
+    return quantized;
+}
+
+//
+// ############################################################################
+//
+
+bool TemporalDither::write_frame(const serial::SerialConnection &serial, NeopixelComms &comms,
+                                 const std::vector<Color16> &colors)
+{
+    dither(colors);
+    comms.build_frame_into(quantized.data(), quantized.size(), encoded);
+    return serial.spi_write_data(encoded.data(), encoded.size(), packet);
+}
+
+//
+// ############################################################################
+//
+
+void TemporalDither::reset()
+{
+    //
+    // If every LED started at zero then a whole strip of the same color would flicker
+    // in lock step, which is a lot easier to see. Starting each one somewhere different
+    // spreads the steps out across the strip
+    //
+    for (size_t i = 0; i < error.size(); ++i)
+    {
+        error[i] = static_cast<uint8_t>(i * 97);
+    }
+}
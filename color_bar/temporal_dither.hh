@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+#include "animations.hh"
+#include "neopixel_comms.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+//
+// Output stage that shows 16 bit colors on an 8 bit strip. Every channel of every LED
+// keeps whatever was rounded off last frame and adds it to the next one, so a value of
+// 2.25 comes out as 2, 2, 2, 3 over four frames and the eye averages that out. It
+// matters most down at the dim end where one step of 8 bit color is a big jump.
+//
+// This only looks right if frames go out fast and steadily, so once the first frame
+// has gone through nothing in write_frame allocates. The color correction in
+// NeopixelComms is applied after dithering, so any gamma should already be in the
+// 16 bit colors
+//
+class TemporalDither
+{
+public: // types //////////////////////////////////////////////////////////////
+    //
+    // The top 8 bits are what an 8 bit Color would be, the bottom 8 are the fraction
+    //
+    struct Color16
+    {
+        uint16_t R;
+        uint16_t G;
+        uint16_t B;
+
+        Color16() : R(0), G(0), B(0)
+        {
+        }
+
+        Color16(const uint16_t R_, const uint16_t G_, const uint16_t B_) : R(R_), G(G_), B(B_)
+        {
+        }
+    };
+
+public: // constructor ////////////////////////////////////////////////////////
+    TemporalDither(const size_t led_count_);
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Round `colors` down to 8 bits, carrying the leftovers into the next frame. The
+    // result stays valid until the next call
+    //
+    const std::vector<animations::Color> &dither(const std::vector<Color16> &colors);
+
+    //
+    // Dither, encode and send a frame
+    //
+    bool write_frame(const serial::SerialConnection &serial, NeopixelComms &comms, const std::vector<Color16> &colors);
+
+    //
+    // Start the leftovers over
+    //
+    void reset();
+
+private: // members ///////////////////////////////////////////////////////////
+    size_t led_count;
+
+    //
+    // What got rounded off last frame, in 1/256ths, 3 per LED
+    //
+    std::vector<uint8_t> error;
+
+    //
+    // Buffers reused every frame
+    //
+    std::vector<animations::Color> quantized;
+    serial::ByteVector_t encoded;
+    serial::ByteVector_t packet;
+};
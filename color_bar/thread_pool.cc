@@ -0,0 +1,210 @@
+#include <algorithm>
+
+#include "thread_pool.hh"
+
+namespace animations
+{
+
+namespace
+{
+
+//
+// Chunks per thread when parallel_for picks the grain, more means better balancing and
+// more queue traffic
+//
+constexpr size_t CHUNKS_PER_THREAD = 8;
+
+}
+
+//
+// ### constructor ############################################################
+//
+
+ThreadPool::ThreadPool(const size_t thread_count_)
+    : queued_tasks(0), stopping(false)
+{
+    const size_t count = thread_count_ > 0 ? thread_count_ : std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < count; ++i)
+    {
+        queues.emplace_back(new WorkQueue());
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        threads.emplace_back(&ThreadPool::run_worker, this, i);
+    }
+}
+
+//
+// ############################################################################
+//
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+//
+// ### public methods #########################################################
+//
+
+void ThreadPool::parallel_for(const size_t count, const RangeFunction_t &function, const size_t grain)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    const size_t chunk_size =
+        grain > 0 ? grain : std::max<size_t>(1, count / (threads.size() * CHUNKS_PER_THREAD));
+    const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+
+    //
+    // Chunks still running or waiting, the last one to finish wakes us up
+    //
+    std::atomic<size_t> remaining(chunk_count);
+    std::mutex done_mutex;
+    std::condition_variable done;
+
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+    {
+        const size_t begin = chunk * chunk_size;
+        const size_t end = std::min(count, begin + chunk_size);
+        push_task(chunk % threads.size(),
+                  [&function, &remaining, &done_mutex, &done, begin, end]
+                  {
+                      function(begin, end);
+
+                      //
+                      // Under the lock, otherwise parallel_for could see 0 and return
+                      // (taking all of this with it) before we're done notifying
+                      //
+                      std::lock_guard<std::mutex> lock(done_mutex);
+                      if (remaining.fetch_sub(1) == 1)
+                      {
+                          done.notify_all();
+                      }
+                  });
+    }
+
+    //
+    // Help out until there's nothing left to steal, then wait for the chunks that are
+    // still running
+    //
+    Task_t task;
+    while (remaining.load() > 0 && pop_task(threads.size(), task))
+    {
+        task();
+        task = nullptr;
+    }
+
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done.wait(lock, [&remaining] { return remaining.load() == 0; });
+}
+
+//
+// ############################################################################
+//
+
+size_t ThreadPool::thread_count() const
+{
+    return threads.size();
+}
+
+//
+// ### private methods ########################################################
+//
+
+void ThreadPool::run_worker(const size_t index)
+{
+    Task_t task;
+    while (true)
+    {
+        if (pop_task(index, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        work_available.wait(lock, [this] { return stopping || queued_tasks.load() > 0; });
+        if (stopping && queued_tasks.load() == 0)
+        {
+            return;
+        }
+    }
+}
+
+//
+// ############################################################################
+//
+
+void ThreadPool::push_task(const size_t index, Task_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+
+    //
+    // Counting before taking the sleep lock means a thread that's about to sleep
+    // either sees the count or gets the notify
+    //
+    queued_tasks.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    work_available.notify_one();
+}
+
+//
+// ############################################################################
+//
+
+bool ThreadPool::pop_task(const size_t index, Task_t &task)
+{
+    //
+    // Our own queue from the back, that's whatever was pushed most recently
+    //
+    if (index < queues.size())
+    {
+        WorkQueue &own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.tasks.empty() == false)
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued_tasks.fetch_sub(1);
+            return true;
+        }
+    }
+
+    //
+    // Everyone else's from the front, starting with our neighbour so the thieves don't
+    // all pile onto the same queue
+    //
+    for (size_t i = 1; i <= queues.size(); ++i)
+    {
+        WorkQueue &victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty() == false)
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_tasks.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace animations
@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+namespace animations
+{
+
+//
+// A handful of threads for chopping up big jobs like precomputing a whole show. Every
+// thread has its own queue and takes work from the back of it, and once that's empty
+// it steals from the front of everyone else's. So a thread that got the slow chunks
+// doesn't leave the others sitting around at the end.
+//
+// The thread calling parallel_for works too (it steals like everyone else), so even a
+// pool on a single core box gets through the work
+//
+class ThreadPool
+{
+public: // types //////////////////////////////////////////////////////////////
+    //
+    // Does the items in [begin, end)
+    //
+    using RangeFunction_t = std::function<void(size_t begin, size_t end)>;
+
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // 0 threads means one per core
+    //
+    ThreadPool(const size_t thread_count_ = 0);
+
+    ThreadPool(const ThreadPool &p) = delete;
+
+    //
+    // Waits for the threads to finish whatever they're working on
+    //
+    ~ThreadPool();
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Run `function` over [0, count) in chunks of `grain` items and wait for all of it
+    // to finish. A grain of 0 picks something that gives every thread a few chunks.
+    // Different chunks run at the same time, so they shouldn't write to the same places
+    //
+    void parallel_for(const size_t count, const RangeFunction_t &function, const size_t grain = 0);
+
+    size_t thread_count() const;
+
+private: // types /////////////////////////////////////////////////////////////
+    using Task_t = std::function<void()>;
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Task_t> tasks;
+    };
+
+private: // methods ///////////////////////////////////////////////////////////
+    //
+    // Runs on every thread until the pool goes away
+    //
+    void run_worker(const size_t index);
+
+    //
+    // Queue a task on thread `index`'s queue and wake someone up
+    //
+    void push_task(const size_t index, Task_t task);
+
+    //
+    // Grab the next task for thread `index`, stealing if its own queue is empty. Anyone
+    // that isn't a pool thread can pass an index past the end to only steal
+    //
+    bool pop_task(const size_t index, Task_t &task);
+
+private: // members ///////////////////////////////////////////////////////////
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> threads;
+
+    //
+    // Threads sleep here when there's nothing in any queue
+    //
+    std::mutex sleep_mutex;
+    std::condition_variable work_available;
+    std::atomic<size_t> queued_tasks;
+    bool stopping;
+};
+
+} // namespace animations
@@ -0,0 +1,245 @@
+#include "capture.hh"
+#include "metrics.hh"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace serial
+{
+
+namespace
+{
+
+//
+// Start with 16MB and double from there, which keeps remapping rare
+//
+constexpr size_t INITIAL_CAPTURE_SIZE = 16 * 1024 * 1024;
+
+}
+
+//
+// ### CaptureWriter ##########################################################
+//
+
+CaptureWriter::CaptureWriter(const std::string &path)
+    : fd(-1), mapping(nullptr), mapped_size(0), used_size(0)
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cout << "ERROR: couldn't open capture file " << path << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (reserve(sizeof(capture::FileHeader)) == false)
+    {
+        return;
+    }
+
+    capture::FileHeader header;
+    std::memcpy(header.magic, capture::MAGIC, sizeof(header.magic));
+    header.reserved = 0;
+    std::memcpy(mapping, &header, sizeof(header));
+    used_size = sizeof(header);
+}
+
+//
+// ############################################################################
+//
+
+CaptureWriter::~CaptureWriter()
+{
+    if (mapping != nullptr)
+    {
+        munmap(mapping, mapped_size);
+    }
+    if (fd >= 0)
+    {
+        //
+        // Chop off the unused space at the end
+        //
+        if (ftruncate(fd, used_size) != 0)
+        {
+            std::cout << "ERROR: couldn't trim capture file" << std::endl;
+        }
+        close(fd);
+    }
+}
+
+//
+// ############################################################################
+//
+
+bool CaptureWriter::append(const BYTE *data, const size_t size)
+{
+    capture::RecordHeader header;
+    header.timestamp_ns = now_ns();
+    header.size = size;
+    header.reserved = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (mapping == nullptr || reserve(used_size + sizeof(header) + size) == false)
+    {
+        return false;
+    }
+
+    std::memcpy(mapping + used_size, &header, sizeof(header));
+    std::memcpy(mapping + used_size + sizeof(header), data, size);
+    used_size += sizeof(header) + size;
+    return true;
+}
+
+//
+// ############################################################################
+//
+
+bool CaptureWriter::is_open() const
+{
+    return mapping != nullptr;
+}
+
+//
+// ############################################################################
+//
+
+bool CaptureWriter::reserve(const size_t needed)
+{
+    if (needed <= mapped_size)
+    {
+        return true;
+    }
+
+    size_t new_size = std::max(mapped_size, INITIAL_CAPTURE_SIZE);
+    while (new_size < needed)
+    {
+        new_size *= 2;
+    }
+
+    if (ftruncate(fd, new_size) != 0)
+    {
+        std::cout << "ERROR: couldn't grow capture file" << std::endl;
+        return false;
+    }
+
+    void *new_mapping = mapping == nullptr
+        ? mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+        : mremap(mapping, mapped_size, new_size, MREMAP_MAYMOVE);
+    if (new_mapping == MAP_FAILED)
+    {
+        std::cout << "ERROR: couldn't map capture file" << std::endl;
+        if (mapping != nullptr)
+        {
+            munmap(mapping, mapped_size);
+        }
+        mapping = nullptr;
+        mapped_size = 0;
+        return false;
+    }
+
+    mapping = static_cast<BYTE *>(new_mapping);
+    mapped_size = new_size;
+    return true;
+}
+
+//
+// ### CaptureReader ##########################################################
+//
+
+CaptureReader::CaptureReader(const std::string &path)
+    : fd(-1), mapping(nullptr), file_size(0), offset(sizeof(capture::FileHeader))
+{
+    fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(capture::FileHeader))
+    {
+        std::cout << "ERROR: couldn't open capture file " << path << std::endl;
+        return;
+    }
+    file_size = info.st_size;
+
+    void *new_mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (new_mapping == MAP_FAILED)
+    {
+        std::cout << "ERROR: couldn't map capture file " << path << std::endl;
+        return;
+    }
+    mapping = static_cast<const BYTE *>(new_mapping);
+    madvise(const_cast<BYTE *>(mapping), file_size, MADV_SEQUENTIAL);
+
+    if (std::memcmp(mapping, capture::MAGIC, sizeof(capture::MAGIC)) != 0)
+    {
+        std::cout << "ERROR: " << path << " isn't a capture file" << std::endl;
+        munmap(const_cast<BYTE *>(mapping), file_size);
+        mapping = nullptr;
+    }
+}
+
+//
+// ############################################################################
+//
+
+CaptureReader::~CaptureReader()
+{
+    if (mapping != nullptr)
+    {
+        munmap(const_cast<BYTE *>(mapping), file_size);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+//
+// ############################################################################
+//
+
+bool CaptureReader::is_open() const
+{
+    return mapping != nullptr;
+}
+
+//
+// ############################################################################
+//
+
+bool CaptureReader::next(Record &record)
+{
+    if (mapping == nullptr || offset + sizeof(capture::RecordHeader) > file_size)
+    {
+        return false;
+    }
+
+    capture::RecordHeader header;
+    std::memcpy(&header, mapping + offset, sizeof(header));
+
+    //
+    // A zero time stamp is the unused tail of a capture that wasn't closed cleanly
+    //
+    if (header.timestamp_ns == 0 || offset + sizeof(header) + header.size > file_size)
+    {
+        return false;
+    }
+
+    record.timestamp_ns = header.timestamp_ns;
+    record.data = mapping + offset + sizeof(header);
+    record.size = header.size;
+    offset += sizeof(header) + header.size;
+    return true;
+}
+
+//
+// ############################################################################
+//
+
+void CaptureReader::rewind()
+{
+    offset = sizeof(capture::FileHeader);
+}
+
+} // namespace serial
@@ -0,0 +1,129 @@
+#pragma once
+#include "ftd2xx.h"
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace serial
+{
+
+//
+// Capture files are a small header followed by records, each record is a
+// RecordHeader and then `size` bytes of exactly what went to write_data.
+// Everything is native endian, these aren't meant to leave the machine they were
+// made on (or at least one with the same endianness)
+//
+namespace capture
+{
+
+constexpr char MAGIC[8] = {'C', 'B', 'C', 'A', 'P', '0', '0', '1'};
+
+struct FileHeader
+{
+    char magic[8];
+    uint64_t reserved;
+};
+
+struct RecordHeader
+{
+    //
+    // Steady clock time the write happened at, never 0 for a real record
+    //
+    uint64_t timestamp_ns;
+    uint32_t size;
+    uint32_t reserved;
+};
+
+} // namespace capture
+
+//
+// Appends buffers to a memory mapped capture file. The file grows as needed and is
+// trimmed down to what was actually used when the writer goes away
+//
+class CaptureWriter
+{
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // Creates (or truncates) the file at `path`
+    //
+    CaptureWriter(const std::string &path);
+
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter &) = delete;
+    CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Add a record with the current time stamp, safe to call from multiple threads
+    //
+    bool append(const BYTE *data, const size_t size);
+
+    //
+    // False if the file couldn't be opened or mapped
+    //
+    bool is_open() const;
+
+private: // methods ///////////////////////////////////////////////////////////
+    //
+    // Make sure the mapping has room for `needed` bytes, the mutex should be held
+    //
+    bool reserve(const size_t needed);
+
+private: // members ///////////////////////////////////////////////////////////
+    int fd;
+    BYTE *mapping;
+    size_t mapped_size;
+    size_t used_size;
+    std::mutex mutex;
+};
+using CaptureWriter_ptr = std::shared_ptr<CaptureWriter>;
+
+//
+// Walks through a capture file that's been mapped in read only
+//
+class CaptureReader
+{
+public: // types //////////////////////////////////////////////////////////////
+    struct Record
+    {
+        uint64_t timestamp_ns = 0;
+        const BYTE *data = nullptr;
+        size_t size = 0;
+    };
+
+public: // constructor ////////////////////////////////////////////////////////
+    CaptureReader(const std::string &path);
+
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader &) = delete;
+    CaptureReader &operator=(const CaptureReader &) = delete;
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // False if the file couldn't be mapped or isn't a capture file
+    //
+    bool is_open() const;
+
+    //
+    // Get the next record, returns false at the end of the file. The data points
+    // into the mapping, so it's good for as long as the reader is around
+    //
+    bool next(Record &record);
+
+    //
+    // Go back to the first record
+    //
+    void rewind();
+
+private: // members ///////////////////////////////////////////////////////////
+    int fd;
+    const BYTE *mapping;
+    size_t file_size;
+    size_t offset;
+};
+
+} // namespace serial
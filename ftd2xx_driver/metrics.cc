@@ -0,0 +1,259 @@
+#include "metrics.hh"
+#include <chrono>
+
+namespace serial
+{
+
+namespace
+{
+
+//
+// Relaxed atomics everywhere, nobody needs ordering between counters
+//
+constexpr std::memory_order RELAXED = std::memory_order_relaxed;
+
+//
+// Bump `value` up to `sample` if it's bigger
+//
+void atomic_max(std::atomic<uint64_t> &value, const uint64_t sample)
+{
+    uint64_t current = value.load(RELAXED);
+    while (sample > current && !value.compare_exchange_weak(current, sample, RELAXED))
+    {
+    }
+}
+
+}
+
+//
+// ### LatencyHistogram #######################################################
+//
+
+LatencyHistogram::LatencyHistogram() : max(0), total(0)
+{
+    for (std::atomic<uint64_t> &count : counts)
+    {
+        count.store(0, RELAXED);
+    }
+}
+
+//
+// ############################################################################
+//
+
+void LatencyHistogram::record(const uint64_t duration_us)
+{
+    //
+    // The bucket is the number of bits needed to hold the duration, so 0 -> 0,
+    // 1 -> 1, 2-3 -> 2, 4-7 -> 3...
+    //
+    size_t bucket = duration_us == 0 ? 0 : 64 - __builtin_clzll(duration_us);
+    if (bucket >= BUCKET_COUNT)
+    {
+        bucket = BUCKET_COUNT - 1;
+    }
+
+    counts[bucket].fetch_add(1, RELAXED);
+    total.fetch_add(duration_us, RELAXED);
+    atomic_max(max, duration_us);
+}
+
+//
+// ############################################################################
+//
+
+std::vector<uint64_t> LatencyHistogram::buckets() const
+{
+    std::vector<uint64_t> result(BUCKET_COUNT);
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        result[i] = counts[i].load(RELAXED);
+    }
+    return result;
+}
+
+//
+// ############################################################################
+//
+
+uint64_t LatencyHistogram::max_us() const
+{
+    return max.load(RELAXED);
+}
+
+//
+// ############################################################################
+//
+
+uint64_t LatencyHistogram::total_us() const
+{
+    return total.load(RELAXED);
+}
+
+//
+// ### MetricsSnapshot ########################################################
+//
+
+uint64_t MetricsSnapshot::percentile_us(const std::vector<uint64_t> &histogram,
+                                        const double percentile)
+{
+    uint64_t sample_count = 0;
+    for (const uint64_t count : histogram)
+    {
+        sample_count += count;
+    }
+    if (sample_count == 0)
+    {
+        return 0;
+    }
+
+    const uint64_t target = static_cast<uint64_t>(percentile * sample_count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < histogram.size(); ++i)
+    {
+        seen += histogram[i];
+        if (seen > target)
+        {
+            return i == 0 ? 0 : (1ull << i) - 1;
+        }
+    }
+    return (1ull << (histogram.size() - 1)) - 1;
+}
+
+//
+// ### Metrics ################################################################
+//
+
+Metrics::Metrics()
+    : writes(0),
+      bytes_written(0),
+      short_writes(0),
+      write_errors(0),
+      frames_written(0),
+      frames_skipped(0),
+      first_frame_ns(0),
+      last_frame_ns(0),
+      frames_played(0)
+{
+    for (std::atomic<uint64_t> &count : error_codes)
+    {
+        count.store(0, RELAXED);
+    }
+}
+
+//
+// ############################################################################
+//
+
+void Metrics::record_write(const uint64_t status,
+                           const uint64_t bytes_requested,
+                           const uint64_t bytes_sent,
+                           const uint64_t duration_us)
+{
+    writes.fetch_add(1, RELAXED);
+    bytes_written.fetch_add(bytes_sent, RELAXED);
+    write_latency.record(duration_us);
+
+    if (status != 0)
+    {
+        write_errors.fetch_add(1, RELAXED);
+        const size_t index = status < ERROR_CODE_COUNT - 1 ? status : ERROR_CODE_COUNT - 1;
+        error_codes[index].fetch_add(1, RELAXED);
+    }
+    else if (bytes_sent != bytes_requested)
+    {
+        short_writes.fetch_add(1, RELAXED);
+    }
+}
+
+//
+// ############################################################################
+//
+
+void Metrics::record_frame_written()
+{
+    const uint64_t now = now_ns();
+    frames_written.fetch_add(1, RELAXED);
+
+    uint64_t no_frame_yet = 0;
+    first_frame_ns.compare_exchange_strong(no_frame_yet, now, RELAXED);
+
+    const uint64_t previous = last_frame_ns.exchange(now, RELAXED);
+    if (previous != 0 && now > previous)
+    {
+        frame_interval.record((now - previous) / 1000);
+    }
+}
+
+//
+// ############################################################################
+//
+
+void Metrics::record_frame_skipped()
+{
+    frames_skipped.fetch_add(1, RELAXED);
+}
+
+//
+// ############################################################################
+//
+
+void Metrics::record_frame_played(const uint64_t encode_duration_us)
+{
+    frames_played.fetch_add(1, RELAXED);
+    encode_latency.record(encode_duration_us);
+}
+
+//
+// ############################################################################
+//
+
+MetricsSnapshot Metrics::snapshot() const
+{
+    MetricsSnapshot s;
+    s.timestamp_ns = now_ns();
+
+    s.writes = writes.load(RELAXED);
+    s.bytes_written = bytes_written.load(RELAXED);
+    s.short_writes = short_writes.load(RELAXED);
+    s.write_errors = write_errors.load(RELAXED);
+    s.error_codes.resize(ERROR_CODE_COUNT);
+    for (size_t i = 0; i < ERROR_CODE_COUNT; ++i)
+    {
+        s.error_codes[i] = error_codes[i].load(RELAXED);
+    }
+    s.write_latency_us = write_latency.buckets();
+    s.write_latency_max_us = write_latency.max_us();
+    s.write_latency_total_us = write_latency.total_us();
+
+    s.frames_written = frames_written.load(RELAXED);
+    s.frames_skipped = frames_skipped.load(RELAXED);
+    s.frame_interval_us = frame_interval.buckets();
+
+    //
+    // Average rate between the first and the most recent frame
+    //
+    const uint64_t first = first_frame_ns.load(RELAXED);
+    const uint64_t last = last_frame_ns.load(RELAXED);
+    if (s.frames_written > 1 && last > first)
+    {
+        s.frames_per_second = (s.frames_written - 1) * 1E9 / (last - first);
+    }
+
+    s.frames_played = frames_played.load(RELAXED);
+    s.encode_latency_us = encode_latency.buckets();
+
+    return s;
+}
+
+//
+// ############################################################################
+//
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace serial
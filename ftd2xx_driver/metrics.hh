@@ -0,0 +1,165 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace serial
+{
+
+//
+// Histogram of durations with power of two buckets. Bucket 0 holds samples of 0us,
+// bucket i holds samples in [2^(i-1), 2^i) microseconds and the last bucket catches
+// everything bigger. Recording is a couple of relaxed atomic adds, so any thread can
+// record into it without taking a lock
+//
+class LatencyHistogram
+{
+public: // constants //////////////////////////////////////////////////////////
+    static constexpr size_t BUCKET_COUNT = 32;
+
+public: // constructor ////////////////////////////////////////////////////////
+    LatencyHistogram();
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Add a single sample
+    //
+    void record(const uint64_t duration_us);
+
+    //
+    // Copy out the current bucket counts, this isn't an atomic copy of the whole
+    // histogram but each bucket is read atomically which is good enough for stats
+    //
+    std::vector<uint64_t> buckets() const;
+
+    //
+    // Largest sample recorded and the sum of all samples
+    //
+    uint64_t max_us() const;
+    uint64_t total_us() const;
+
+private: // members ///////////////////////////////////////////////////////////
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> total;
+};
+
+//
+// Plain copy of all of the metrics at some point in time
+//
+struct MetricsSnapshot
+{
+    //
+    // Steady clock time (in nanoseconds) when the snapshot was taken, use this with
+    // two snapshots to get rates over some window
+    //
+    uint64_t timestamp_ns = 0;
+
+    //
+    // Raw FT_Write statistics. A short write is an FT_OK write that sent less than we
+    // asked it to, `error_codes` is indexed by the FT_STATUS that came back
+    //
+    uint64_t writes = 0;
+    uint64_t bytes_written = 0;
+    uint64_t short_writes = 0;
+    uint64_t write_errors = 0;
+    std::vector<uint64_t> error_codes;
+    std::vector<uint64_t> write_latency_us;
+    uint64_t write_latency_max_us = 0;
+    uint64_t write_latency_total_us = 0;
+
+    //
+    // Frames that went through spi_write_data, and the time between them. Skipped
+    // frames are ones that weren't sent because they matched the last one
+    //
+    uint64_t frames_written = 0;
+    uint64_t frames_skipped = 0;
+    std::vector<uint64_t> frame_interval_us;
+    double frames_per_second = 0.0;
+
+    //
+    // Frames that went through animations::play_frames and how long they took to encode
+    //
+    uint64_t frames_played = 0;
+    std::vector<uint64_t> encode_latency_us;
+
+    //
+    // Estimate a percentile (0.0 to 1.0) from one of the histograms above. This
+    // returns the upper edge of the bucket the percentile lands in
+    //
+    static uint64_t percentile_us(const std::vector<uint64_t> &histogram, const double percentile);
+};
+
+//
+// All of the counters for an output path. Everything is lock free so this can be
+// poked from the write path on every call without anyone noticing
+//
+class Metrics
+{
+public: // constants //////////////////////////////////////////////////////////
+    //
+    // One counter for each FT_STATUS value plus one for anything we don't know about
+    //
+    static constexpr size_t ERROR_CODE_COUNT = 21;
+
+public: // constructor ////////////////////////////////////////////////////////
+    Metrics();
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Record the result of a single FT_Write call
+    //
+    void record_write(const uint64_t status,
+                      const uint64_t bytes_requested,
+                      const uint64_t bytes_sent,
+                      const uint64_t duration_us);
+
+    //
+    // Record that a frame has been sent out with spi_write_data
+    //
+    void record_frame_written();
+
+    //
+    // Record that spi_write_data didn't send a frame because the strip already has it
+    //
+    void record_frame_skipped();
+
+    //
+    // Record that play_frames pushed a frame and how long the encode took
+    //
+    void record_frame_played(const uint64_t encode_duration_us);
+
+    //
+    // Grab a copy of everything
+    //
+    MetricsSnapshot snapshot() const;
+
+private: // members ///////////////////////////////////////////////////////////
+    std::atomic<uint64_t> writes;
+    std::atomic<uint64_t> bytes_written;
+    std::atomic<uint64_t> short_writes;
+    std::atomic<uint64_t> write_errors;
+    std::array<std::atomic<uint64_t>, ERROR_CODE_COUNT> error_codes;
+    LatencyHistogram write_latency;
+
+    std::atomic<uint64_t> frames_written;
+    std::atomic<uint64_t> frames_skipped;
+    std::atomic<uint64_t> first_frame_ns;
+    std::atomic<uint64_t> last_frame_ns;
+    LatencyHistogram frame_interval;
+
+    std::atomic<uint64_t> frames_played;
+    LatencyHistogram encode_latency;
+};
+
+using Metrics_ptr = std::shared_ptr<Metrics>;
+
+//
+// Steady clock now in nanoseconds, used for all of the timestamps above
+//
+uint64_t now_ns();
+
+} // namespace serial
@@ -0,0 +1,177 @@
+#include "overlapped_writer.hh"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+//
+// These come from windows.h on Windows, the Linux D2XX library wants the same values
+//
+#ifndef ERROR_IO_PENDING
+#define ERROR_IO_PENDING 997
+#endif
+
+namespace serial
+{
+
+//
+// ### constructor ############################################################
+//
+
+OverlappedWriter::OverlappedWriter(const FT_HANDLE ft_handle_,
+                                   const Metrics_ptr metrics_,
+                                   const size_t slot_count,
+                                   const size_t chunk_size_)
+    : ft_handle(ft_handle_),
+      metrics(metrics_),
+      chunk_size(std::max<size_t>(chunk_size_, 1)),
+      slots(std::max<size_t>(slot_count, 1)),
+      next_slot(0),
+      next_to_reap(0),
+      in_flight_count(0),
+      failed(false),
+      running(true)
+{
+    for (Slot &slot : slots)
+    {
+        slot.buffer.reserve(chunk_size);
+    }
+    reaper = std::thread(&OverlappedWriter::reap_completions, this);
+}
+
+//
+// ############################################################################
+//
+
+OverlappedWriter::~OverlappedWriter()
+{
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    slot_issued.notify_all();
+    reaper.join();
+}
+
+//
+// ### public methods #########################################################
+//
+
+bool OverlappedWriter::write(const BYTE *data, const size_t size)
+{
+    for (size_t offset = 0; offset < size; offset += chunk_size)
+    {
+        const size_t this_chunk = std::min(chunk_size, size - offset);
+
+        //
+        // Wait for the next slot in the ring to come back from the reaper
+        //
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_freed.wait(lock, [this]() { return slots[next_slot].in_flight == false; });
+
+        //
+        // Once any of the stream has gone missing, the rest of this write would land in
+        // the middle of whatever command lost its bytes. Better to stop here
+        //
+        if (take_success() == false)
+        {
+            return false;
+        }
+        Slot &slot = slots[next_slot];
+        lock.unlock();
+
+        //
+        // Nobody else touches a slot that isn't in flight, so this can happen without
+        // the lock. The buffer has to live until the write completes
+        //
+        slot.buffer.assign(data + offset, data + offset + this_chunk);
+        std::memset(&slot.overlapped, 0, sizeof(slot.overlapped));
+        slot.issued_ns = now_ns();
+
+        DWORD bytes_written = 0;
+        const BOOL done = FT_W32_WriteFile(ft_handle, slot.buffer.data(), this_chunk, &bytes_written, &slot.overlapped);
+        if (done == FALSE && FT_W32_GetLastError(ft_handle) != ERROR_IO_PENDING)
+        {
+            std::cout << "ERROR: overlapped write failed to start" << std::endl;
+            metrics->record_write(FT_IO_ERROR, this_chunk, 0, 0);
+            return false;
+        }
+
+        //
+        // Either it's pending or it finished right away, the reaper handles both
+        //
+        lock.lock();
+        slot.in_flight = true;
+        ++in_flight_count;
+        next_slot = (next_slot + 1) % slots.size();
+        lock.unlock();
+        slot_issued.notify_one();
+    }
+
+    return true;
+}
+
+//
+// ############################################################################
+//
+
+bool OverlappedWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    slot_freed.wait(lock, [this]() { return in_flight_count == 0; });
+    return take_success();
+}
+
+//
+// ### private methods ########################################################
+//
+
+void OverlappedWriter::reap_completions()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_issued.wait(lock, [this]() { return in_flight_count > 0 || running == false; });
+        if (in_flight_count == 0)
+        {
+            return;
+        }
+        Slot &slot = slots[next_to_reap];
+        lock.unlock();
+
+        //
+        // Writes finish in the order they were issued, so just wait on the oldest
+        //
+        DWORD bytes_written = 0;
+        const BOOL done = FT_W32_GetOverlappedResult(ft_handle, &slot.overlapped, &bytes_written, TRUE);
+        const size_t bytes_requested = slot.buffer.size();
+        metrics->record_write(done == FALSE ? FT_IO_ERROR : FT_OK,
+                              bytes_requested,
+                              bytes_written,
+                              (now_ns() - slot.issued_ns) / 1000);
+
+        lock.lock();
+        if (done == FALSE || bytes_written != bytes_requested)
+        {
+            failed = true;
+        }
+        slot.in_flight = false;
+        --in_flight_count;
+        next_to_reap = (next_to_reap + 1) % slots.size();
+        lock.unlock();
+        slot_freed.notify_all();
+    }
+}
+
+//
+// ############################################################################
+//
+
+bool OverlappedWriter::take_success()
+{
+    const bool success = failed == false;
+    failed = false;
+    return success;
+}
+
+} // namespace serial
@@ -0,0 +1,101 @@
+#pragma once
+#include "ftd2xx.h"
+#include "metrics.hh"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace serial
+{
+
+//
+// Keeps a few USB writes in flight at once using the overlapped W32 API, instead of
+// waiting for each FT_Write to finish before starting the next one. Writes get split
+// into `chunk_size` pieces, each piece gets its own slot and a background thread reaps
+// the completions in order and hands the slots back.
+//
+// The device has to be opened with FT_W32_CreateFile and FILE_FLAG_OVERLAPPED for
+// this to work, SerialConnection does that when it's made with WriteMode::OVERLAPPED.
+//
+// Only one thread can be calling write at a time. Two writers could both grab the same
+// slot, and their chunks would get interleaved on the wire anyway
+//
+class OverlappedWriter
+{
+public: // constructor ////////////////////////////////////////////////////////
+    OverlappedWriter(const FT_HANDLE ft_handle,
+                     const Metrics_ptr metrics,
+                     const size_t slot_count = 8,
+                     const size_t chunk_size = 65536);
+
+    //
+    // Waits for everything in flight to finish
+    //
+    ~OverlappedWriter();
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Queue up some data. This only blocks if every slot is already in flight. Since
+    // the actual writes finish later, a failure shows up on the next call to write
+    // or flush. After a failure the rest of `data` isn't queued, chunks after a gap
+    // would just be garbage to the MPSSE
+    //
+    bool write(const BYTE *data, const size_t size);
+
+    //
+    // Wait until everything queued so far is done, returns false if any of it failed
+    //
+    bool flush();
+
+private: // types /////////////////////////////////////////////////////////////
+    struct Slot
+    {
+        OVERLAPPED overlapped;
+        std::vector<BYTE> buffer;
+        uint64_t issued_ns = 0;
+        bool in_flight = false;
+    };
+
+private: // methods ///////////////////////////////////////////////////////////
+    //
+    // Background thread, waits on the oldest write in flight and frees its slot
+    //
+    void reap_completions();
+
+    //
+    // True if nothing has failed since the last time this was called, and clears the
+    // sticky error flag. The mutex needs to be held
+    //
+    bool take_success();
+
+private: // members ///////////////////////////////////////////////////////////
+    FT_HANDLE ft_handle;
+    Metrics_ptr metrics;
+    size_t chunk_size;
+
+    //
+    // Slots are used in a ring, `next_slot` is the next one to issue and
+    // `next_to_reap` is the oldest one in flight
+    //
+    std::vector<Slot> slots;
+    size_t next_slot;
+    size_t next_to_reap;
+    size_t in_flight_count;
+
+    //
+    // Set when something fails, cleared when it gets reported
+    //
+    bool failed;
+
+    bool running;
+    std::mutex mutex;
+    std::condition_variable slot_freed;
+    std::condition_variable slot_issued;
+    std::thread reaper;
+};
+
+using OverlappedWriter_ptr = std::shared_ptr<OverlappedWriter>;
+
+} // namespace serial
@@ -1,11 +1,82 @@
 #include "serial.hh"
+#include "trace.hh"
 #include <assert.h>
 #include <iostream>
 #include <thread>
 #include <chrono>
 #include <iomanip>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 
+//
+// These come from windows.h on Windows, the Linux D2XX library wants the same values
+//
+#ifndef GENERIC_READ
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#endif
+#ifndef OPEN_EXISTING
+#define OPEN_EXISTING 3
+#endif
+#ifndef FILE_ATTRIBUTE_NORMAL
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#endif
+#ifndef FILE_FLAG_OVERLAPPED
+#define FILE_FLAG_OVERLAPPED 0x40000000
+#endif
+
+namespace
+{
+
+//
+// Cheap 64 bit hash for whole frames. It eats 8 bytes at a time (the murmur style
+// multiply and shift) so hashing a frame costs a lot less than encoding it, and it only
+// has to be good enough to tell two frames apart
+//
+uint64_t frame_hash(const BYTE *data, const size_t size)
+{
+    constexpr uint64_t MULTIPLIER = 0xC6A4A7935BD1E995ull;
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ (size * MULTIPLIER);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        word *= MULTIPLIER;
+        word ^= word >> 47;
+        word *= MULTIPLIER;
+        hash = (hash ^ word) * MULTIPLIER;
+    }
+
+    uint64_t tail = 0;
+    for (size_t k = 0; i + k < size; ++k)
+    {
+        tail |= static_cast<uint64_t>(data[i + k]) << (8 * k);
+    }
+    hash = (hash ^ tail) * MULTIPLIER;
+
+    hash ^= hash >> 47;
+    hash *= MULTIPLIER;
+    hash ^= hash >> 47;
+    return hash;
+}
+
+//
+// Tell the tracer when the strip should have latched a packet, see trace::Stage::LATCHED
+//
+void trace_latched(const uint64_t write_start_ns, const size_t packet_size, const double spi_clock_hz)
+{
+    if (serial::trace::enabled() == false || spi_clock_hz <= 0.0)
+    {
+        return;
+    }
+    const uint64_t wire_done_ns = write_start_ns + static_cast<uint64_t>(packet_size * 8 * 1E9 / spi_clock_hz);
+    serial::trace::mark(serial::trace::Stage::LATCHED, std::max(serial::now_ns(), wire_done_ns));
+}
+
+}
 
 
 namespace serial
@@ -15,8 +86,14 @@ namespace serial
 // ### constructor ############################################################
 //
 
-SerialConnection::SerialConnection(const unsigned int device_number)
+SerialConnection::SerialConnection(const unsigned int device_number, const WriteMode mode)
+    : write_metrics(std::make_shared<Metrics>()),
+      write_mode(mode),
+      duplicate_filter(std::make_shared<DuplicateFilter>()),
+      spi_clock_hz(0.0)
 {
+    set_skip_duplicate_frames(false);
+
     //
     // Let's do some basic set up of the port here, don't trust me - trust
     // http://www.ftdichip.com/Support/Documents/AppNotes/AN_135_MPSSE_Basics.pdf
@@ -35,9 +112,29 @@ SerialConnection::SerialConnection(const unsigned int device_number)
     }
 
     //
-    // Try to open it
+    // Try to open it. Overlapped writes only work if the device was opened through
+    // the W32 API with the overlapped flag, and that API wants the serial number
     //
-    assert(FT_Open(device_number, &ft_handle) == FT_OK);
+    if (write_mode == WriteMode::OVERLAPPED)
+    {
+        char serial_number[16] = {0};
+        DWORD flags, type, id, location;
+        FT_HANDLE unused_handle;
+        assert(FT_GetDeviceInfoDetail(device_number, &flags, &type, &id, &location,
+                                      serial_number, nullptr, &unused_handle) == FT_OK);
+        ft_handle = FT_W32_CreateFile(serial_number,
+                                      GENERIC_READ | GENERIC_WRITE,
+                                      0,
+                                      nullptr,
+                                      OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FT_OPEN_BY_SERIAL_NUMBER,
+                                      nullptr);
+        assert(ft_handle != reinterpret_cast<FT_HANDLE>(INVALID_HANDLE_VALUE));
+    }
+    else
+    {
+        assert(FT_Open(device_number, &ft_handle) == FT_OK);
+    }
     std::cout << "Device opened successfully!" << std::endl;
 
     //
@@ -61,14 +158,12 @@ SerialConnection::SerialConnection(const unsigned int device_number)
     //
     // Some needed configs
     //
-    // Set USB request transfer sizes to 64K
-    ft_status |= FT_SetUSBParameters(ft_handle, 65536, 65535);
     // Disable event and error characters
     ft_status |= FT_SetChars(ft_handle, false, 0, false, 0);
     // Sets the read and write timeouts in milliseconds
     ft_status |= FT_SetTimeouts(ft_handle, 0, 5000);
-    // Set the latency timer to 1mS (default is 16mS) 
-    ft_status |= FT_SetLatencyTimer(ft_handle, 1); 
+    // Set USB request transfer sizes to 64K and the latency timer to 1mS (default is 16mS)
+    ft_status |= set_usb_parameters(UsbSettings()) ? FT_OK : FT_OTHER_ERROR;
     // Turn on flow control to synchronize IN requests
     ft_status |= FT_SetFlowControl(ft_handle, FT_FLOW_RTS_CTS, 0x00, 0x00);
     // Reset controller
@@ -78,6 +173,26 @@ SerialConnection::SerialConnection(const unsigned int device_number)
 
     assert(ft_status == FT_OK);
     std::cout << "MPSSE mode enabled successfully!" << std::endl;
+
+    if (write_mode == WriteMode::OVERLAPPED)
+    {
+        overlapped_writer = std::make_shared<OverlappedWriter>(ft_handle, write_metrics);
+    }
+}
+
+//
+// ############################################################################
+//
+
+SerialConnection::SerialConnection(const TransportBase_ptr transport_)
+    : ft_handle(nullptr),
+      write_metrics(std::make_shared<Metrics>()),
+      write_mode(WriteMode::BLOCKING),
+      transport(transport_),
+      duplicate_filter(std::make_shared<DuplicateFilter>()),
+      spi_clock_hz(0.0)
+{
+    set_skip_duplicate_frames(false);
 }
 
 //
@@ -87,6 +202,13 @@ SerialConnection::SerialConnection(const unsigned int device_number)
 SerialConnection::SerialConnection(const SerialConnection &s)
 {
     ft_handle = s.ft_handle;
+    write_metrics = s.write_metrics;
+    write_mode = s.write_mode;
+    overlapped_writer = s.overlapped_writer;
+    transport = s.transport;
+    capture_writer = std::atomic_load(&s.capture_writer);
+    duplicate_filter = s.duplicate_filter;
+    spi_clock_hz = s.spi_clock_hz;
 }
 
 //
@@ -95,8 +217,26 @@ SerialConnection::SerialConnection(const SerialConnection &s)
 
 SerialConnection::~SerialConnection()
 {
+    //
+    // Anything still in flight needs to finish before the handle goes away
+    //
+    flush();
+    overlapped_writer.reset();
+
+    if (transport)
+    {
+        return;
+    }
+
     FT_SetBitMode(ft_handle, 0x0, 0x00);
-    FT_Close(ft_handle);
+    if (write_mode == WriteMode::OVERLAPPED)
+    {
+        FT_W32_CloseHandle(ft_handle);
+    }
+    else
+    {
+        FT_Close(ft_handle);
+    }
 }
 
 //
@@ -105,13 +245,42 @@ SerialConnection::~SerialConnection()
 
 bool SerialConnection::write_data(ByteVector_t data) const
 {
-    const unsigned int bytes_to_send = data.size();
-    unsigned int bytes_sent = 0;
-    FT_STATUS ft_status = FT_Write(ft_handle, data.data(), bytes_to_send, &bytes_sent);
+    return write_data(data.data(), data.size());
+}
 
-    // for (BYTE &b : data)
+//
+// ############################################################################
+//
+
+bool SerialConnection::write_data(const BYTE *data, const size_t size) const
+{
+    const CaptureWriter_ptr capture = std::atomic_load(&capture_writer);
+    if (capture)
+    {
+        capture->append(data, size);
+    }
+
+    if (overlapped_writer)
+    {
+        trace::mark(trace::Stage::WRITE_BEGIN);
+        const bool queued = overlapped_writer->write(data, size);
+        trace::mark(trace::Stage::WRITE_END);
+        return queued;
+    }
+
+    const unsigned int bytes_to_send = size;
+    unsigned int bytes_sent = 0;
+    const uint64_t start_ns = now_ns();
+    trace::mark(trace::Stage::WRITE_BEGIN, start_ns);
+    FT_STATUS ft_status = transport
+        ? transport->write(data, bytes_to_send, bytes_sent)
+        : FT_Write(ft_handle, const_cast<BYTE *>(data), bytes_to_send, &bytes_sent);
+    trace::mark(trace::Stage::WRITE_END);
+    write_metrics->record_write(ft_status, bytes_to_send, bytes_sent, (now_ns() - start_ns) / 1000);
+
+    // for (size_t i = 0; i < size; ++i)
     // {
-    //     std::cout << "0x" << std::hex << std::setfill('0') << std::setw(2) << (uint32_t) b << " ";
+    //     std::cout << "0x" << std::hex << std::setfill('0') << std::setw(2) << (uint32_t) data[i] << " ";
     // }
     // std::cout << std::dec << "(" << ft_status << ")" << " sent: " << bytes_sent << std::endl;
 
@@ -127,8 +296,34 @@ bool SerialConnection::write_data(ByteVector_t data) const
 // ############################################################################
 //
 
+bool SerialConnection::flush() const
+{
+    if (overlapped_writer)
+    {
+        return overlapped_writer->flush();
+    }
+    return true;
+}
+
+//
+// ############################################################################
+//
+
 ByteVector_t SerialConnection::block_and_read(const unsigned int num_bytes_to_read) const
 {
+    //
+    // Whatever we're waiting on a response for might still be in flight
+    //
+    flush();
+
+    //
+    // Nothing ever comes back from a fake transport
+    //
+    if (transport)
+    {
+        return {};
+    }
+
     unsigned int bytes_ready = 0;
     FT_STATUS ft_status = FT_OK;
 
@@ -170,17 +365,48 @@ ByteVector_t SerialConnection::block_and_read(const unsigned int num_bytes_to_re
 
 bool SerialConnection::spi_write_data(ByteVector_t data) const
 {
-    const uint16_t data_length = data.size() - 1;
-    const BYTE length_L = data_length & 0xFF;
-    const BYTE length_H = (data_length >> 8);
+    uint64_t hash = 0;
+    if (is_duplicate_frame(data.data(), data.size(), hash))
+    {
+        write_metrics->record_frame_skipped();
+        return true;
+    }
 
-    //
-    // Append header data
-    //
-    ByteVector_t header_data = {mpsse::MSB_R_EDGE_OUT_BYTE, length_L, length_H};
-    data.insert(data.begin(), header_data.begin(), header_data.end());
+    const ByteVector_t packet = spi_packet(data.data(), data.size());
+    const uint64_t write_start_ns = now_ns();
+    const bool success = write_data(packet.data(), packet.size());
+    if (success)
+    {
+        write_metrics->record_frame_written();
+        frame_sent(hash, data.size());
+        trace_latched(write_start_ns, packet.size(), spi_clock_hz);
+    }
+    return success;
+}
+
+//
+// ############################################################################
+//
+
+bool SerialConnection::spi_write_data(const BYTE *data, const size_t size, ByteVector_t &packet) const
+{
+    uint64_t hash = 0;
+    if (is_duplicate_frame(data, size, hash))
+    {
+        write_metrics->record_frame_skipped();
+        return true;
+    }
 
-    return write_data(std::move(data));
+    spi_packet_into(data, size, packet);
+    const uint64_t write_start_ns = now_ns();
+    const bool success = write_data(packet.data(), packet.size());
+    if (success)
+    {
+        write_metrics->record_frame_written();
+        frame_sent(hash, size);
+        trace_latched(write_start_ns, packet.size(), spi_clock_hz);
+    }
+    return success;
 }
 
 //
@@ -206,6 +432,10 @@ bool SerialConnection::get_pin(const size_t pin_number) const
     write_data(request);
 
     ByteVector_t response = block_and_read(1);
+    if (response.empty())
+    {
+        return false;
+    }
     std::cout << static_cast<uint16_t>(response[0]) << std::endl;
     return (response[0] >> pin_number_offset) & 1;
 }
@@ -226,7 +456,7 @@ void SerialConnection::set_pin(const size_t pin_number, bool high) const
 // ############################################################################
 //
 
-void SerialConnection::configure_spi_defaults() const
+double SerialConnection::configure_spi_defaults(const double target_clock_hz)
 {
     //
     // Hardware parameters that should be set to default.
@@ -237,9 +467,13 @@ void SerialConnection::configure_spi_defaults() const
     write_data(hardware_config);
 
     //
-    // We want a 6mhz clock, this divisor does that according to documentation
+    // Get as close to the clock we want as the divisor lets us
     //
-    write_data({mpsse::SET_TCK_DIVISOR, 0x05, 0x00});
+    const uint16_t divisor = spi_clock_divisor(target_clock_hz);
+    write_data({mpsse::SET_TCK_DIVISOR,
+                static_cast<BYTE>(divisor & 0xFF),
+                static_cast<BYTE>(divisor >> 8)});
+    spi_clock_hz = spi_clock_hz_for_divisor(divisor);
 
     //
     // We need to configure the default value and direction for both D and C pins
@@ -249,7 +483,103 @@ void SerialConnection::configure_spi_defaults() const
 
     write_data({mpsse::LOOPBACK_DISABLE});
 
-    std::cout << "SPI Configuration Successful!" << std::endl;
+    std::cout << "SPI Configuration Successful! Clock is " << spi_clock_hz << "Hz" << std::endl;
+    return spi_clock_hz;
+}
+
+//
+// ############################################################################
+//
+
+double SerialConnection::get_spi_clock_hz() const
+{
+    return spi_clock_hz;
+}
+
+//
+// ############################################################################
+//
+
+uint16_t SerialConnection::spi_clock_divisor(const double target_clock_hz)
+{
+    //
+    // Solve for the divisor and then check the divisors on either side of it, since
+    // the clock is 1/x in the divisor rounding the divisor isn't always closest
+    //
+    if (target_clock_hz <= 0.0)
+    {
+        return 0xFFFF;
+    }
+    const double exact = 30E6 / target_clock_hz - 1.0;
+    const double low = std::min(std::max(std::floor(exact), 0.0), 65535.0);
+    const double high = std::min(low + 1.0, 65535.0);
+
+    const double low_error = std::abs(spi_clock_hz_for_divisor(low) - target_clock_hz);
+    const double high_error = std::abs(spi_clock_hz_for_divisor(high) - target_clock_hz);
+    return static_cast<uint16_t>(low_error <= high_error ? low : high);
+}
+
+//
+// ############################################################################
+//
+
+ByteVector_t SerialConnection::spi_packet(const BYTE *data, const size_t size)
+{
+    ByteVector_t packet;
+    spi_packet_into(data, size, packet);
+    return packet;
+}
+
+//
+// ############################################################################
+//
+
+void SerialConnection::spi_packet_into(const BYTE *data, const size_t size, ByteVector_t &packet)
+{
+    //
+    // The length in the command is only 16 bits (and one less than the real length)
+    // so anything bigger than 64K gets split into a few commands. They all go out in
+    // the same write so the MPSSE runs them back to back
+    //
+    const size_t chunk_count = (size + MAX_SPI_COMMAND_BYTES - 1) / MAX_SPI_COMMAND_BYTES;
+    packet.resize(size + 3 * chunk_count);
+
+    BYTE *out = packet.data();
+    for (size_t offset = 0; offset < size; offset += MAX_SPI_COMMAND_BYTES)
+    {
+        const size_t chunk_size = std::min(MAX_SPI_COMMAND_BYTES, size - offset);
+        const uint16_t data_length = chunk_size - 1;
+
+        //
+        // Header data first
+        //
+        out[0] = mpsse::MSB_R_EDGE_OUT_BYTE;
+        out[1] = data_length & 0xFF;
+        out[2] = data_length >> 8;
+        std::memcpy(out + 3, data + offset, chunk_size);
+        out += 3 + chunk_size;
+    }
+}
+
+//
+// ############################################################################
+//
+
+bool SerialConnection::set_usb_parameters(const UsbSettings &settings) const
+{
+    if (transport)
+    {
+        return true;
+    }
+
+    //
+    // The out transfer size is passed along too, but most versions of the driver
+    // only really honor the in size. The last byte is reserved, hence the -1
+    //
+    FT_STATUS ft_status = FT_OK;
+    ft_status |= FT_SetUSBParameters(ft_handle, settings.transfer_size, settings.transfer_size - 1);
+    ft_status |= FT_SetLatencyTimer(ft_handle, settings.latency_timer_ms);
+    return status_okay(ft_status);
 }
 
 //
@@ -277,6 +607,38 @@ void SerialConnection::run_comms_check() const
     std::cout << "Passed! ============================\n" << std::endl;
 }
 
+//
+// ############################################################################
+//
+
+Metrics &SerialConnection::metrics() const
+{
+    return *write_metrics;
+}
+
+//
+// ############################################################################
+//
+
+void SerialConnection::set_capture(const CaptureWriter_ptr capture)
+{
+    std::atomic_store(&capture_writer, capture);
+}
+
+//
+// ############################################################################
+//
+
+void SerialConnection::set_skip_duplicate_frames(const bool skip, const double refresh_interval_ms)
+{
+    //
+    // Forget the last frame so the next one always goes out
+    //
+    duplicate_filter->last_size.store(UINT64_MAX, std::memory_order_relaxed);
+    duplicate_filter->refresh_interval_ns.store(std::max(refresh_interval_ms, 0.0) * 1E6, std::memory_order_relaxed);
+    duplicate_filter->enabled.store(skip, std::memory_order_relaxed);
+}
+
 //
 // ### private methods ########################################################
 //
@@ -311,4 +673,48 @@ inline void SerialConnection::check_bad_response(const ByteVector_t &recv_buffer
     }
 }
 
+//
+// ############################################################################
+//
+
+bool SerialConnection::is_duplicate_frame(const BYTE *data, const size_t size, uint64_t &hash) const
+{
+    const DuplicateFilter &filter = *duplicate_filter;
+    if (filter.enabled.load(std::memory_order_relaxed) == false)
+    {
+        return false;
+    }
+
+    hash = frame_hash(data, size);
+    if (hash != filter.last_hash.load(std::memory_order_relaxed) ||
+        size != filter.last_size.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    //
+    // Same frame, unless it's been long enough that we should send it again
+    //
+    const uint64_t refresh_interval_ns = filter.refresh_interval_ns.load(std::memory_order_relaxed);
+    return refresh_interval_ns == 0 ||
+           now_ns() - filter.last_sent_ns.load(std::memory_order_relaxed) < refresh_interval_ns;
+}
+
+//
+// ############################################################################
+//
+
+void SerialConnection::frame_sent(const uint64_t hash, const size_t size) const
+{
+    DuplicateFilter &filter = *duplicate_filter;
+    if (filter.enabled.load(std::memory_order_relaxed) == false)
+    {
+        return;
+    }
+
+    filter.last_hash.store(hash, std::memory_order_relaxed);
+    filter.last_size.store(size, std::memory_order_relaxed);
+    filter.last_sent_ns.store(now_ns(), std::memory_order_relaxed);
+}
+
 } // namespace serial
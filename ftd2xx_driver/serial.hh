@@ -1,5 +1,10 @@
 #pragma once
 #include "ftd2xx.h"
+#include "metrics.hh"
+#include "overlapped_writer.hh"
+#include "capture.hh"
+#include "transport.hh"
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -22,6 +27,7 @@ enum mpsse : unsigned char
     LOOPBACK_DISABLE             = 0x85,
     SET_TCK_DIVISOR              = 0x86, // VAL_L, VAL_H
     CLOCK_60_MHZ                 = 0x8A,
+    CLOCK_12_MHZ                 = 0x8B,
     THREE_PHASE_CLOCKING_ENABLE  = 0x8C,
     THREE_PHASE_CLOCKING_DISABLE = 0x8D,
     ADAPTIVE_CLOCKING_ENABLE     = 0x96,
@@ -29,11 +35,44 @@ enum mpsse : unsigned char
     BAD_COMMANDS                 = 0xFA
 };
 
+//
+// A single MSB_R_EDGE_OUT_BYTE command can clock out at most this many bytes
+//
+constexpr size_t MAX_SPI_COMMAND_BYTES = 65536;
+
 //
 // Public type used by others when writing data to the board
 //
 using ByteVector_t = std::vector<BYTE>;
 
+//
+// USB level knobs for the device. The defaults are what we've always used, the
+// usb_tuning helpers can find something better for a specific frame size
+//
+struct UsbSettings
+{
+    //
+    // USB request transfer size in bytes, needs to be a multiple of 64 between 64 and 64K
+    //
+    DWORD transfer_size = 65536;
+
+    //
+    // How long (in milliseconds) the chip waits before sending a short packet back
+    //
+    UCHAR latency_timer_ms = 1;
+};
+
+//
+// How writes get to the device. BLOCKING does one FT_Write at a time, OVERLAPPED keeps
+// several chunks in flight with the W32 overlapped API (see OverlappedWriter). With
+// OVERLAPPED only one thread should be writing at a time
+//
+enum class WriteMode
+{
+    BLOCKING,
+    OVERLAPPED
+};
+
 //
 // Connects to an FTDI serial connection and has some nice wrappers C++11 around the
 // gross C
@@ -41,7 +80,13 @@ using ByteVector_t = std::vector<BYTE>;
 class SerialConnection
 {
 public: // constructor ////////////////////////////////////////////////////////
-    SerialConnection(const unsigned int device_number = 0);
+    SerialConnection(const unsigned int device_number = 0, const WriteMode mode = WriteMode::BLOCKING);
+
+    //
+    // Don't open a device at all, everything that would have gone to FT_Write goes to
+    // `transport` instead. Reads never return anything in this mode
+    //
+    SerialConnection(const TransportBase_ptr transport);
 
     SerialConnection(const SerialConnection &s);
 
@@ -54,6 +99,17 @@ public: // publicest methods //////////////////////////////////////////////////
     //
     bool write_data(ByteVector_t data) const;
 
+    //
+    // Same as above without needing a vector
+    //
+    bool write_data(const BYTE *data, const size_t size) const;
+
+    //
+    // Wait for any writes that are still in flight to finish. Only does anything in
+    // OVERLAPPED mode, returns false if one of them failed
+    //
+    bool flush() const;
+
     //
     // Wait until we have some number of bytes in the receive buffer,
     // read them, clear them, and return the data
@@ -66,6 +122,12 @@ public: // publicest methods //////////////////////////////////////////////////
     //
     bool spi_write_data(ByteVector_t data) const;
 
+    //
+    // Same as above, but the packet gets built in `packet` which the caller keeps
+    // around between frames so nothing gets allocated
+    //
+    bool spi_write_data(const BYTE *data, const size_t size, ByteVector_t &packet) const;
+
     //
     // Request the data that is on a pin. According to the documentation, there are two
     // pin sets: D and C. D is the lower byte and C is the upper byte. The Pin number
@@ -84,9 +146,40 @@ public: // publicest methods //////////////////////////////////////////////////
 public: // more public methods ////////////////////////////////////////////////
     //
     // Sets default values for pins and what not - maybe this should go in the
-    // constructor?
+    // constructor? The SPI clock is set as close as we can get to `target_clock_hz`,
+    // and the clock we actually ended up with is returned
+    //
+    double configure_spi_defaults(const double target_clock_hz = 5E6);
+
+    //
+    // The SPI clock we're running at, 0 if it hasn't been configured yet
+    //
+    double get_spi_clock_hz() const;
+
+    //
+    // Apply new USB transfer size and latency timer settings. Can be called at any
+    // time, returns false if the driver didn't like them
+    //
+    bool set_usb_parameters(const UsbSettings &settings) const;
+
+public: // static methods /////////////////////////////////////////////////////
+    //
+    // With the 60MHz master clock TCK = 60MHz / ((1 + divisor) * 2). These go back and
+    // forth between that divisor and the clock it makes, picking the closest divisor
     //
-    void configure_spi_defaults() const;
+    static uint16_t spi_clock_divisor(const double target_clock_hz);
+    static constexpr double spi_clock_hz_for_divisor(const uint16_t divisor)
+    {
+        return 60E6 / ((1.0 + divisor) * 2.0);
+    }
+
+    //
+    // Wrap some data up in the MPSSE commands that clock it out on the SPI data pin.
+    // This is exactly what spi_write_data sends for `data`. The _into version builds it
+    // in a buffer that can be reused
+    //
+    static ByteVector_t spi_packet(const BYTE *data, const size_t size);
+    static void spi_packet_into(const BYTE *data, const size_t size, ByteVector_t &packet);
 
     //
     // Basic test script - sends some bad data and ensures it gets an error back
@@ -94,6 +187,41 @@ public: // more public methods ////////////////////////////////////////////////
     //
     void run_comms_check() const;
 
+    //
+    // Counters and histograms for everything that went out over this connection.
+    // Copies of a connection share the same metrics
+    //
+    Metrics &metrics() const;
+
+    //
+    // Record every buffer that goes through write_data into a capture file (see
+    // tools/replay_capture.cc). Pass nullptr to stop capturing, this can be called
+    // while another thread is writing
+    //
+    void set_capture(const CaptureWriter_ptr capture);
+
+    //
+    // Don't send a frame through spi_write_data if it's exactly what the last one was,
+    // the strip is already showing it. Every `refresh_interval_ms` the same frame goes
+    // out anyway in case the strip glitched, 0 means never. Shared between copies,
+    // and it's off until this turns it on
+    //
+    void set_skip_duplicate_frames(const bool skip, const double refresh_interval_ms = 1000.0);
+
+private: // types /////////////////////////////////////////////////////////////
+    //
+    // What we know about the last frame that went out. Frames are compared by a 64 bit
+    // hash of their data and their size
+    //
+    struct DuplicateFilter
+    {
+        std::atomic<bool> enabled;
+        std::atomic<uint64_t> refresh_interval_ns;
+        std::atomic<uint64_t> last_hash;
+        std::atomic<uint64_t> last_size;
+        std::atomic<uint64_t> last_sent_ns;
+    };
+
 private: // methods ///////////////////////////////////////////////////////////
     //
     // Makes sure the status return FT_OK
@@ -105,6 +233,17 @@ private: // methods ///////////////////////////////////////////////////////////
     //
     inline void check_bad_response(const ByteVector_t &recv_buffer) const;
 
+    //
+    // True if `data` is the same frame that went out last and it isn't time for a
+    // refresh yet. Otherwise `hash` is filled in for frame_sent
+    //
+    bool is_duplicate_frame(const BYTE *data, const size_t size, uint64_t &hash) const;
+
+    //
+    // Remember a frame that made it out
+    //
+    void frame_sent(const uint64_t hash, const size_t size) const;
+
 private: // members ///////////////////////////////////////////////////////////
 
     //
@@ -112,6 +251,37 @@ private: // members ///////////////////////////////////////////////////////////
     //
     FT_HANDLE ft_handle;
 
+    //
+    // Lock free stats about the write path
+    //
+    Metrics_ptr write_metrics;
+
+    //
+    // Only set in OVERLAPPED mode
+    //
+    WriteMode write_mode;
+    OverlappedWriter_ptr overlapped_writer;
+
+    //
+    // Set when there's no real device behind this connection
+    //
+    TransportBase_ptr transport;
+
+    //
+    // Where writes get tapped to, if anywhere
+    //
+    CaptureWriter_ptr capture_writer;
+
+    //
+    // For skipping frames that are the same as the last one
+    //
+    std::shared_ptr<DuplicateFilter> duplicate_filter;
+
+    //
+    // What the SPI clock was actually set to
+    //
+    double spi_clock_hz;
+
 };
 
 
@@ -0,0 +1,264 @@
+#include "show_file.hh"
+#include "serial.hh"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+
+namespace serial
+{
+
+namespace
+{
+
+//
+// Every packet starts on a cache line
+//
+constexpr uint64_t FRAME_ALIGNMENT = 64;
+
+uint64_t align_up(const uint64_t offset)
+{
+    return (offset + FRAME_ALIGNMENT - 1) & ~(FRAME_ALIGNMENT - 1);
+}
+
+}
+
+//
+// ### ShowWriter #############################################################
+//
+
+ShowWriter::ShowWriter(const std::string &path, const double spi_clock_hz, const size_t led_count)
+    : fd(-1), end_offset(align_up(sizeof(show::FileHeader)))
+{
+    std::memcpy(header.magic, show::MAGIC, sizeof(header.magic));
+    header.spi_clock_hz = spi_clock_hz;
+    header.led_count = led_count;
+    header.frame_count = 0;
+    header.index_offset = 0;
+
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cout << "ERROR: couldn't open show file " << path << std::endl;
+        return;
+    }
+
+    //
+    // An unfinished header, so a show that never gets finished can't be played
+    //
+    if (write_at(&header, sizeof(header), 0) == false)
+    {
+        close(fd);
+        fd = -1;
+    }
+}
+
+//
+// ############################################################################
+//
+
+ShowWriter::~ShowWriter()
+{
+    finish();
+}
+
+//
+// ############################################################################
+//
+
+bool ShowWriter::append_frame(const BYTE *encoded, const size_t size, const uint32_t hold_time_ms)
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    SerialConnection::spi_packet_into(encoded, size, packet);
+    if (write_at(packet.data(), packet.size(), end_offset) == false)
+    {
+        return false;
+    }
+
+    show::IndexEntry entry;
+    entry.offset = end_offset;
+    entry.size = packet.size();
+    entry.hold_time_ms = hold_time_ms;
+    index.push_back(entry);
+
+    end_offset = align_up(end_offset + packet.size());
+    return true;
+}
+
+//
+// ############################################################################
+//
+
+bool ShowWriter::finish()
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    header.frame_count = index.size();
+    header.index_offset = end_offset;
+    const bool success = write_at(index.data(), index.size() * sizeof(show::IndexEntry), end_offset) &&
+                         write_at(&header, sizeof(header), 0);
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return success;
+}
+
+//
+// ############################################################################
+//
+
+bool ShowWriter::is_open() const
+{
+    return fd >= 0;
+}
+
+//
+// ############################################################################
+//
+
+bool ShowWriter::write_at(const void *data, const size_t size, const uint64_t offset)
+{
+    const BYTE *bytes = static_cast<const BYTE *>(data);
+    size_t written = 0;
+    while (written < size)
+    {
+        const ssize_t result = pwrite(fd, bytes + written, size - written, offset + written);
+        if (result <= 0)
+        {
+            std::cout << "ERROR: couldn't write to show file" << std::endl;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+//
+// ### ShowReader #############################################################
+//
+
+ShowReader::ShowReader(const std::string &path)
+    : fd(-1), mapping(nullptr), file_size(0), index(nullptr)
+{
+    std::memset(&header, 0, sizeof(header));
+
+    fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(show::FileHeader))
+    {
+        std::cout << "ERROR: couldn't open show file " << path << std::endl;
+        return;
+    }
+    file_size = info.st_size;
+
+    void *new_mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (new_mapping == MAP_FAILED)
+    {
+        std::cout << "ERROR: couldn't map show file " << path << std::endl;
+        return;
+    }
+    mapping = static_cast<const BYTE *>(new_mapping);
+    madvise(const_cast<BYTE *>(mapping), file_size, MADV_SEQUENTIAL);
+
+    std::memcpy(&header, mapping, sizeof(header));
+    const uint64_t index_size = header.frame_count * sizeof(show::IndexEntry);
+    bool valid = std::memcmp(header.magic, show::MAGIC, sizeof(header.magic)) == 0 &&
+                 header.index_offset != 0 && header.index_offset % alignof(show::IndexEntry) == 0 &&
+                 header.index_offset <= file_size && index_size <= file_size - header.index_offset;
+    if (valid)
+    {
+        index = reinterpret_cast<const show::IndexEntry *>(mapping + header.index_offset);
+        for (size_t i = 0; i < header.frame_count && valid; ++i)
+        {
+            valid = index[i].offset + index[i].size <= header.index_offset;
+        }
+    }
+
+    if (valid == false)
+    {
+        std::cout << "ERROR: " << path << " isn't a finished show file" << std::endl;
+        munmap(const_cast<BYTE *>(mapping), file_size);
+        mapping = nullptr;
+        index = nullptr;
+    }
+}
+
+//
+// ############################################################################
+//
+
+ShowReader::~ShowReader()
+{
+    if (mapping != nullptr)
+    {
+        munmap(const_cast<BYTE *>(mapping), file_size);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+//
+// ############################################################################
+//
+
+bool ShowReader::is_open() const
+{
+    return mapping != nullptr;
+}
+
+//
+// ############################################################################
+//
+
+size_t ShowReader::frame_count() const
+{
+    return is_open() ? header.frame_count : 0;
+}
+
+//
+// ############################################################################
+//
+
+size_t ShowReader::led_count() const
+{
+    return header.led_count;
+}
+
+//
+// ############################################################################
+//
+
+double ShowReader::spi_clock_hz() const
+{
+    return header.spi_clock_hz;
+}
+
+//
+// ############################################################################
+//
+
+ShowReader::Frame ShowReader::frame(const size_t index_number) const
+{
+    Frame frame;
+    frame.data = mapping + index[index_number].offset;
+    frame.size = index[index_number].size;
+    frame.hold_time_ms = index[index_number].hold_time_ms;
+    return frame;
+}
+
+} // namespace serial
@@ -0,0 +1,146 @@
+#pragma once
+#include "ftd2xx.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace serial
+{
+
+//
+// Show files hold a whole animation that's already been encoded and wrapped up in the
+// MPSSE commands, so playing one back is nothing but handing bytes to write_data. The
+// layout is a FileHeader, then every frame's packet (each one starting on a 64 byte
+// boundary), then an IndexEntry for every frame. Native endian, same as captures
+//
+namespace show
+{
+
+constexpr char MAGIC[8] = {'C', 'B', 'S', 'H', 'O', 'W', '0', '1'};
+
+struct FileHeader
+{
+    char magic[8];
+
+    //
+    // The frames only look right on the wire at the clock they were encoded for
+    //
+    double spi_clock_hz;
+    uint64_t led_count;
+    uint64_t frame_count;
+
+    //
+    // Where the index starts, 0 if the file was never finished
+    //
+    uint64_t index_offset;
+};
+
+struct IndexEntry
+{
+    uint64_t offset;
+    uint32_t size;
+    uint32_t hold_time_ms;
+};
+
+} // namespace show
+
+//
+// Writes a show file one frame at a time. Nothing is valid until finish() (or the
+// destructor) writes the index
+//
+class ShowWriter
+{
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    // Creates (or truncates) the file at `path`
+    //
+    ShowWriter(const std::string &path, const double spi_clock_hz, const size_t led_count);
+
+    ~ShowWriter();
+
+    ShowWriter(const ShowWriter &) = delete;
+    ShowWriter &operator=(const ShowWriter &) = delete;
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Add an encoded frame (what NeopixelComms::build_frame makes), it gets wrapped
+    // up the same way spi_write_data would before it goes in the file
+    //
+    bool append_frame(const BYTE *encoded, const size_t size, const uint32_t hold_time_ms);
+
+    //
+    // Write the index and the header, nothing can be added after this
+    //
+    bool finish();
+
+    //
+    // False if the file couldn't be opened or a write failed
+    //
+    bool is_open() const;
+
+private: // methods ///////////////////////////////////////////////////////////
+    bool write_at(const void *data, const size_t size, const uint64_t offset);
+
+private: // members ///////////////////////////////////////////////////////////
+    int fd;
+    show::FileHeader header;
+    std::vector<show::IndexEntry> index;
+    uint64_t end_offset;
+
+    //
+    // Reused for every frame
+    //
+    std::vector<BYTE> packet;
+};
+
+//
+// A show file mapped in read only. The kernel is told it'll be read front to back, so
+// it reads ahead and drops pages behind us, which keeps a long show from filling up
+// memory on a small box
+//
+class ShowReader
+{
+public: // types //////////////////////////////////////////////////////////////
+    struct Frame
+    {
+        //
+        // Ready for write_data, points into the mapping
+        //
+        const BYTE *data = nullptr;
+        size_t size = 0;
+        uint32_t hold_time_ms = 0;
+    };
+
+public: // constructor ////////////////////////////////////////////////////////
+    ShowReader(const std::string &path);
+
+    ~ShowReader();
+
+    ShowReader(const ShowReader &) = delete;
+    ShowReader &operator=(const ShowReader &) = delete;
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // False if the file couldn't be mapped, isn't a show file or wasn't finished
+    //
+    bool is_open() const;
+
+    size_t frame_count() const;
+    size_t led_count() const;
+    double spi_clock_hz() const;
+
+    //
+    // Frame `index`, which has to be less than frame_count()
+    //
+    Frame frame(const size_t index) const;
+
+private: // members ///////////////////////////////////////////////////////////
+    int fd;
+    const BYTE *mapping;
+    size_t file_size;
+    show::FileHeader header;
+    const show::IndexEntry *index;
+};
+
+} // namespace serial
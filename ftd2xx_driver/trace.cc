@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "metrics.hh"
+#include "trace.hh"
+
+namespace serial
+{
+namespace trace
+{
+
+namespace
+{
+
+constexpr auto RELAXED = std::memory_order_relaxed;
+
+//
+// One thread's events. Only the thread that owns it ever writes, `head` is how many
+// events it has written so far and event i lives in slot i % RING_SIZE. The slots are
+// relaxed atomics so a dump reading them while they're being written isn't a data
+// race, it just gets thrown out when `head` says it might have been overwritten
+//
+struct Ring
+{
+    struct Slot
+    {
+        std::atomic<uint64_t> timestamp_ns;
+
+        //
+        // Frame id in the top 56 bits, the stage in the bottom 8
+        //
+        std::atomic<uint64_t> frame_and_stage;
+    };
+
+    size_t thread_index = 0;
+    std::atomic<uint64_t> head{0};
+
+    //
+    // Set by clear(), events before this are ignored
+    //
+    std::atomic<uint64_t> first{0};
+
+    std::array<Slot, RING_SIZE> slots;
+};
+
+struct Event
+{
+    uint64_t timestamp_ns;
+    uint64_t frame_id;
+    size_t thread_index;
+    Stage stage;
+};
+
+std::atomic<bool> tracing_enabled(false);
+std::atomic<uint64_t> next_frame_id(1);
+
+//
+// Every ring that's been made, rings stick around after their thread goes away so
+// the events can still be dumped. The mutex is only taken when a thread makes its
+// ring and when dumping
+//
+std::mutex rings_mutex;
+std::vector<std::shared_ptr<Ring>> all_rings;
+
+thread_local std::shared_ptr<Ring> thread_ring;
+thread_local uint64_t thread_frame = 0;
+
+Ring &ring_for_this_thread()
+{
+    if (!thread_ring)
+    {
+        thread_ring = std::make_shared<Ring>();
+
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        thread_ring->thread_index = all_rings.size();
+        all_rings.push_back(thread_ring);
+    }
+    return *thread_ring;
+}
+
+//
+// Copy out everything in `ring` that's still good
+//
+void read_ring(const Ring &ring, std::vector<Event> &events)
+{
+    const uint64_t head = ring.head.load(std::memory_order_acquire);
+    const uint64_t first = std::max(ring.first.load(RELAXED), head > RING_SIZE ? head - RING_SIZE : 0);
+
+    const size_t start = events.size();
+    for (uint64_t i = first; i < head; ++i)
+    {
+        const Ring::Slot &slot = ring.slots[i % RING_SIZE];
+        const uint64_t frame_and_stage = slot.frame_and_stage.load(RELAXED);
+        events.push_back({slot.timestamp_ns.load(RELAXED), frame_and_stage >> 8, ring.thread_index,
+                          static_cast<Stage>(frame_and_stage & 0xFF)});
+    }
+
+    //
+    // Anything the thread got around to overwriting while we were copying is junk. The
+    // thread could be partway through writing event `head_after`, which lands on top of
+    // event `head_after - RING_SIZE`
+    //
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t head_after = ring.head.load(RELAXED);
+    if (head_after >= RING_SIZE && head_after - RING_SIZE >= first)
+    {
+        const size_t bad = std::min<uint64_t>(head_after - RING_SIZE - first + 1, events.size() - start);
+        events.erase(events.begin() + start, events.begin() + start + bad);
+    }
+}
+
+const char *stage_name(const Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::GENERATED:
+        return "generated";
+    case Stage::ENCODED:
+        return "encoded";
+    case Stage::ENQUEUED:
+        return "enqueued";
+    case Stage::WRITE_BEGIN:
+        return "write begin";
+    case Stage::WRITE_END:
+        return "write end";
+    case Stage::LATCHED:
+        return "latched";
+    }
+    return "unknown";
+}
+
+//
+// Chrome wants microseconds, everything is relative to the first event so the numbers
+// stay small
+//
+double trace_us(const uint64_t timestamp_ns, const uint64_t base_ns)
+{
+    return (timestamp_ns - base_ns) / 1E3;
+}
+
+void write_async(std::ostream &out, const char phase, const char *name, const uint64_t frame_id,
+                 const size_t thread_index, const double ts_us)
+{
+    out << ",\n{\"name\":\"" << name << "\",\"cat\":\"frame\",\"ph\":\"" << phase << "\",\"id\":" << frame_id
+        << ",\"pid\":1,\"tid\":" << thread_index + 1 << ",\"ts\":" << ts_us << "}";
+}
+
+}
+
+//
+// ############################################################################
+//
+
+void enable(const bool on)
+{
+    tracing_enabled.store(on, RELAXED);
+}
+
+//
+// ############################################################################
+//
+
+bool enabled()
+{
+    return tracing_enabled.load(RELAXED);
+}
+
+//
+// ############################################################################
+//
+
+void mark(const Stage stage)
+{
+    if (enabled() == false || thread_frame == 0)
+    {
+        return;
+    }
+    mark(stage, now_ns());
+}
+
+//
+// ############################################################################
+//
+
+void mark(const Stage stage, const uint64_t timestamp_ns)
+{
+    if (enabled() == false || thread_frame == 0)
+    {
+        return;
+    }
+
+    Ring &ring = ring_for_this_thread();
+    const uint64_t index = ring.head.load(RELAXED);
+    Ring::Slot &slot = ring.slots[index % RING_SIZE];
+    slot.timestamp_ns.store(timestamp_ns, RELAXED);
+    slot.frame_and_stage.store((thread_frame << 8) | static_cast<uint8_t>(stage), RELAXED);
+    ring.head.store(index + 1, std::memory_order_release);
+}
+
+//
+// ############################################################################
+//
+
+uint64_t current_frame()
+{
+    return thread_frame;
+}
+
+//
+// ### ScopedFrame ############################################################
+//
+
+ScopedFrame::ScopedFrame() : previous_frame(thread_frame)
+{
+    if (thread_frame == 0 && enabled())
+    {
+        thread_frame = next_frame_id.fetch_add(1, RELAXED);
+    }
+}
+
+//
+// ############################################################################
+//
+
+ScopedFrame::ScopedFrame(const uint64_t frame_id) : previous_frame(thread_frame)
+{
+    thread_frame = frame_id;
+}
+
+//
+// ############################################################################
+//
+
+ScopedFrame::~ScopedFrame()
+{
+    thread_frame = previous_frame;
+}
+
+//
+// ############################################################################
+//
+
+bool write_chrome_trace(const std::string &path)
+{
+    std::vector<Event> events;
+    size_t thread_count = 0;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        for (const std::shared_ptr<Ring> &ring : all_rings)
+        {
+            read_ring(*ring, events);
+        }
+        thread_count = all_rings.size();
+    }
+
+    std::ofstream out(path, std::ios::trunc);
+    if (out.good() == false)
+    {
+        std::cout << "ERROR: Unable to open " << path << " for the trace" << std::endl;
+        return false;
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"color_bar\"}}";
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i + 1
+            << ",\"args\":{\"name\":\"thread " << i + 1 << "\"}}";
+    }
+
+    if (events.empty() == false)
+    {
+        const uint64_t base_ns =
+            std::min_element(events.begin(), events.end(),
+                             [](const Event &a, const Event &b) { return a.timestamp_ns < b.timestamp_ns; })
+                ->timestamp_ns;
+
+        //
+        // Writes are slices on the thread that did them. Each thread's events are in
+        // order, so a write's end comes right after its begin
+        //
+        for (size_t i = 1; i < events.size(); ++i)
+        {
+            const Event &begin = events[i - 1];
+            const Event &end = events[i];
+            if (begin.stage == Stage::WRITE_BEGIN && end.stage == Stage::WRITE_END &&
+                begin.thread_index == end.thread_index && begin.frame_id == end.frame_id)
+            {
+                out << ",\n{\"name\":\"write\",\"cat\":\"usb\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    << begin.thread_index + 1 << ",\"ts\":" << trace_us(begin.timestamp_ns, base_ns)
+                    << ",\"dur\":" << (end.timestamp_ns - begin.timestamp_ns) / 1E3
+                    << ",\"args\":{\"frame\":" << begin.frame_id << "}}";
+            }
+        }
+
+        //
+        // Then the frames, with every frame's stages (which could have come from a few
+        // threads) put back together in time order
+        //
+        std::stable_sort(events.begin(), events.end(),
+                         [](const Event &a, const Event &b)
+                         {
+                             return a.frame_id != b.frame_id ? a.frame_id < b.frame_id
+                                                             : a.timestamp_ns < b.timestamp_ns;
+                         });
+
+        size_t frame_start = 0;
+        for (size_t i = 1; i <= events.size(); ++i)
+        {
+            if (i < events.size() && events[i].frame_id == events[frame_start].frame_id)
+            {
+                continue;
+            }
+
+            const Event &first = events[frame_start];
+            const Event &last = events[i - 1];
+            write_async(out, 'b', "frame", first.frame_id, first.thread_index,
+                        trace_us(first.timestamp_ns, base_ns));
+            for (size_t k = frame_start + 1; k < i; ++k)
+            {
+                const char *name = stage_name(events[k].stage);
+                write_async(out, 'b', name, first.frame_id, events[k].thread_index,
+                            trace_us(events[k - 1].timestamp_ns, base_ns));
+                write_async(out, 'e', name, first.frame_id, events[k].thread_index,
+                            trace_us(events[k].timestamp_ns, base_ns));
+            }
+            write_async(out, 'e', "frame", first.frame_id, last.thread_index, trace_us(last.timestamp_ns, base_ns));
+
+            frame_start = i;
+        }
+    }
+
+    out << "\n]}\n";
+    return out.good();
+}
+
+//
+// ############################################################################
+//
+
+void clear()
+{
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (const std::shared_ptr<Ring> &ring : all_rings)
+    {
+        ring->first.store(ring->head.load(std::memory_order_acquire), RELAXED);
+    }
+}
+
+} // namespace trace
+} // namespace serial
@@ -0,0 +1,98 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace serial
+{
+
+//
+// Per frame stage tracing. Every stage a frame goes through gets a timestamp, so when a
+// show stutters it's possible to see which stage ate the frame's budget.
+//
+// This is off until enable(true) is called, and while it's off marking a stage is one
+// relaxed load. While it's on each thread writes into its own ring of events (nothing
+// is shared, so no locks), and the oldest events get overwritten once a ring is full.
+// write_chrome_trace dumps everything that's still in the rings as Chrome trace JSON,
+// which chrome://tracing or https://ui.perfetto.dev can open
+//
+namespace trace
+{
+
+enum class Stage : uint8_t
+{
+    GENERATED,
+    ENCODED,
+    ENQUEUED,
+    WRITE_BEGIN,
+    WRITE_END,
+
+    //
+    // The strip doesn't tell us when it latches, so this is when the last byte should
+    // have been clocked out: the end of the write or the wire time after its start,
+    // whichever is later
+    //
+    LATCHED
+};
+
+//
+// Events each thread keeps before the oldest start getting overwritten
+//
+constexpr size_t RING_SIZE = 1 << 14;
+
+void enable(const bool on);
+bool enabled();
+
+//
+// Record `stage` for the frame the calling thread is working on (see ScopedFrame), at
+// the current time or at `timestamp_ns`. Does nothing if tracing is off or the thread
+// isn't working on a frame
+//
+void mark(const Stage stage);
+void mark(const Stage stage, const uint64_t timestamp_ns);
+
+//
+// The frame the calling thread is working on, 0 if there isn't one
+//
+uint64_t current_frame();
+
+//
+// Says which frame the calling thread is working on while it's around, so the stages
+// marked deeper down (in the encoder or in write_data) know what frame they're for.
+//
+// The default constructor starts a new frame, unless the thread is already working on
+// one in which case it keeps that one. Handing a frame to another thread is done by
+// taking current_frame() along and making a ScopedFrame with it over there
+//
+class ScopedFrame
+{
+public: // constructor ////////////////////////////////////////////////////////
+    ScopedFrame();
+    explicit ScopedFrame(const uint64_t frame_id);
+    ~ScopedFrame();
+
+    ScopedFrame(const ScopedFrame &) = delete;
+    ScopedFrame &operator=(const ScopedFrame &) = delete;
+
+private: // members ///////////////////////////////////////////////////////////
+    uint64_t previous_frame;
+};
+
+//
+// Dump every thread's events to `path` as Chrome trace JSON. Each frame shows up as its
+// own row going from its first stage to its last, split up into a slice per stage that
+// covers the time since the stage before it (so a long "encoded" slice means encoding
+// was slow). The writes also show up as slices on the thread that did them. This can
+// run while things are still being traced, events that get overwritten during the dump
+// are left out
+//
+bool write_chrome_trace(const std::string &path);
+
+//
+// Drop every event recorded so far
+//
+void clear();
+
+} // namespace trace
+
+} // namespace serial
@@ -0,0 +1,60 @@
+#pragma once
+#include "ftd2xx.h"
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+namespace serial
+{
+
+//
+// Something other than an FTDI device that a SerialConnection can write to. This is
+// what lets the whole output path run on a box without any hardware plugged in
+//
+class TransportBase
+{
+public: // constructor ////////////////////////////////////////////////////////
+    //
+    //
+    //
+    TransportBase() = default;
+
+    //
+    //
+    //
+    virtual ~TransportBase() = default;
+
+public: // methods ////////////////////////////////////////////////////////////
+    //
+    // Same contract as FT_Write: return an FT_STATUS and fill in how many bytes went out
+    //
+    virtual FT_STATUS write(const BYTE *data, const size_t size, DWORD &bytes_written) = 0;
+};
+using TransportBase_ptr = std::shared_ptr<TransportBase>;
+
+//
+// Swallows everything as fast as it can and counts it
+//
+class NullTransport final : public TransportBase
+{
+public: // methods ////////////////////////////////////////////////////////////
+    FT_STATUS write(const BYTE *, const size_t size, DWORD &bytes_written) override
+    {
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        bytes_written = size;
+        return FT_OK;
+    }
+
+    //
+    // Total number of bytes written so far
+    //
+    size_t bytes_received() const
+    {
+        return bytes.load(std::memory_order_relaxed);
+    }
+
+private: // members ///////////////////////////////////////////////////////////
+    std::atomic<size_t> bytes{0};
+};
+
+} // namespace serial
@@ -0,0 +1,233 @@
+#include "usb_tuning.hh"
+#include <stdlib.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace serial
+{
+
+namespace
+{
+
+bool same_settings(const UsbSettings &a, const UsbSettings &b)
+{
+    return a.transfer_size == b.transfer_size && a.latency_timer_ms == b.latency_timer_ms;
+}
+
+}
+
+//
+// ############################################################################
+//
+
+std::vector<UsbSettings> default_usb_candidates()
+{
+    std::vector<UsbSettings> candidates;
+    for (const DWORD transfer_size : {4096, 16384, 32768, 65536})
+    {
+        UsbSettings settings;
+        settings.transfer_size = transfer_size;
+        candidates.push_back(settings);
+    }
+    return candidates;
+}
+
+//
+// ############################################################################
+//
+
+bool calibrate_usb(const SerialConnection &serial,
+                   const size_t frame_size,
+                   CalibrationResult &best,
+                   const std::vector<UsbSettings> &candidates,
+                   const size_t frames_per_round,
+                   const size_t rounds,
+                   std::vector<CalibrationResult> *all_results)
+{
+    //
+    // All zeros never has a high pulse in it, so the strip won't change while we're
+    // doing this. The GET_D_BUS_DATA makes the chip answer with one byte once everything
+    // in front of it has been clocked out. These go through write_data so skipping
+    // duplicate frames can't skip them
+    //
+    const ByteVector_t frame = SerialConnection::spi_packet(ByteVector_t(frame_size, 0x00).data(), frame_size);
+    const BYTE sync = mpsse::GET_D_BUS_DATA;
+
+    const auto delivered = [&serial, &sync]()
+    { return serial.write_data(&sync, 1) && serial.block_and_read(1).size() == 1; };
+
+    //
+    // The defaults go first, they're what everything else has to beat
+    //
+    std::vector<UsbSettings> measuring(1, UsbSettings());
+    for (const UsbSettings &settings : candidates)
+    {
+        if (same_settings(settings, UsbSettings()) == false)
+        {
+            measuring.push_back(settings);
+        }
+    }
+
+    std::vector<std::vector<double>> samples(measuring.size());
+    for (size_t round = 0; round < rounds && frames_per_round > 0; ++round)
+    {
+        for (size_t c = 0; c < measuring.size(); ++c)
+        {
+            //
+            // Get the new settings warmed up and the chip empty before timing anything
+            //
+            if (serial.set_usb_parameters(measuring[c]) == false || delivered() == false)
+            {
+                continue;
+            }
+
+            bool measured = true;
+            const uint64_t start_ns = now_ns();
+            for (size_t i = 0; i < frames_per_round && measured; ++i)
+            {
+                measured = serial.write_data(frame.data(), frame.size());
+            }
+            measured = measured && delivered();
+            const uint64_t elapsed_ns = now_ns() - start_ns;
+
+            if (measured)
+            {
+                samples[c].push_back(1E9 * frame.size() * frames_per_round / std::max<uint64_t>(elapsed_ns, 1));
+            }
+        }
+    }
+
+    //
+    // Only candidates that made it through every round count, one with a round missing
+    // doesn't have a real spread
+    //
+    std::vector<CalibrationResult> results;
+    for (size_t c = 0; c < measuring.size(); ++c)
+    {
+        if (samples[c].empty() || samples[c].size() != rounds)
+        {
+            continue;
+        }
+
+        CalibrationResult result;
+        result.settings = measuring[c];
+        double sum = 0.0;
+        for (const double sample : samples[c])
+        {
+            sum += sample;
+        }
+        result.bytes_per_second = sum / samples[c].size();
+        result.min_bytes_per_second = *std::min_element(samples[c].begin(), samples[c].end());
+        result.max_bytes_per_second = *std::max_element(samples[c].begin(), samples[c].end());
+        results.push_back(result);
+
+        std::cout << "USB transfer size " << result.settings.transfer_size << ", latency timer "
+                  << static_cast<int>(result.settings.latency_timer_ms) << "ms: "
+                  << result.bytes_per_second / 1E6 << " MB/s (" << result.min_bytes_per_second / 1E6 << " to "
+                  << result.max_bytes_per_second / 1E6 << ")" << std::endl;
+    }
+
+    if (all_results != nullptr)
+    {
+        *all_results = results;
+    }
+
+    if (results.empty() || same_settings(results.front().settings, UsbSettings()) == false)
+    {
+        std::cout << "ERROR: Unable to measure frame delivery with the default USB settings" << std::endl;
+        serial.set_usb_parameters(UsbSettings());
+        return false;
+    }
+
+    const CalibrationResult &defaults = results.front();
+    best = *std::max_element(results.begin(), results.end(),
+                             [](const CalibrationResult &a, const CalibrationResult &b)
+                             { return a.bytes_per_second < b.bytes_per_second; });
+
+    if (best.min_bytes_per_second <= defaults.max_bytes_per_second)
+    {
+        std::cout << "USB settings don't make a difference bigger than the noise for " << frame_size
+                  << " byte frames, keeping the defaults" << std::endl;
+        serial.set_usb_parameters(UsbSettings());
+        return false;
+    }
+
+    serial.set_usb_parameters(best.settings);
+    return true;
+}
+
+//
+// ############################################################################
+//
+
+std::string default_usb_settings_path()
+{
+    const char *home = getenv("HOME");
+    return std::string(home == nullptr ? "." : home) + "/.color_bar_usb";
+}
+
+//
+// ############################################################################
+//
+
+bool save_usb_settings(const std::string &path, const size_t frame_size, const UsbSettings &settings)
+{
+    //
+    // Read everything that's there already so we only replace our own line
+    //
+    std::map<size_t, UsbSettings> all_settings;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        size_t size = 0;
+        DWORD transfer_size = 0;
+        unsigned int latency_timer_ms = 0;
+        if (fields >> size >> transfer_size >> latency_timer_ms)
+        {
+            all_settings[size].transfer_size = transfer_size;
+            all_settings[size].latency_timer_ms = latency_timer_ms;
+        }
+    }
+    in.close();
+
+    all_settings[frame_size] = settings;
+
+    std::ofstream out(path, std::ios::trunc);
+    for (const auto &entry : all_settings)
+    {
+        out << entry.first << " " << entry.second.transfer_size << " "
+            << static_cast<unsigned int>(entry.second.latency_timer_ms) << "\n";
+    }
+    return out.good();
+}
+
+//
+// ############################################################################
+//
+
+bool load_usb_settings(const std::string &path, const size_t frame_size, UsbSettings &settings)
+{
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        size_t size = 0;
+        DWORD transfer_size = 0;
+        unsigned int latency_timer_ms = 0;
+        if ((fields >> size >> transfer_size >> latency_timer_ms) && size == frame_size)
+        {
+            settings.transfer_size = transfer_size;
+            settings.latency_timer_ms = latency_timer_ms;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace serial
@@ -0,0 +1,76 @@
+#pragma once
+#include "serial.hh"
+#include <string>
+#include <vector>
+
+namespace serial
+{
+
+//
+// How one set of USB settings did during calibration
+//
+struct CalibrationResult
+{
+    UsbSettings settings;
+
+    //
+    // Bytes per second of frames written back to back, averaged over the rounds, and
+    // the slowest and fastest round. How far apart those two are is how much the
+    // numbers wander from run to run with the same settings
+    //
+    double bytes_per_second = 0.0;
+    double min_bytes_per_second = 0.0;
+    double max_bytes_per_second = 0.0;
+};
+
+//
+// The settings we try if the caller doesn't have any better ideas. These are just the
+// transfer sizes, the latency timer stays at 1ms in all of them
+//
+std::vector<UsbSettings> default_usb_candidates();
+
+//
+// Time how fast `frame_size` byte blank frames get delivered with every candidate, and
+// put the fastest in `best`. Each round writes `frames_per_round` frames back to back
+// and then waits for a GET_D_BUS_DATA to come back, which only happens once the chip
+// has clocked everything out. The rounds go through all the candidates in turn so
+// anything else going on on the bus hits them all the same.
+//
+// The read at the end of a round waits on the latency timer, so candidates should all
+// have the same latency timer or the slow ones lose by however long it makes that read
+// wait. Playback never reads, so the latency timer doesn't matter there anyway.
+//
+// The default settings get measured too. If the best candidate's slowest round isn't
+// faster than the defaults' fastest round (or nothing could be measured, like with a
+// fake transport) the difference is just noise, so this returns false and puts the
+// default settings back and there's nothing worth saving. Otherwise it returns true
+// with the best settings applied.
+//
+// Every candidate that was measured ends up in `all_results` if it's given
+//
+bool calibrate_usb(const SerialConnection &serial,
+                   const size_t frame_size,
+                   CalibrationResult &best,
+                   const std::vector<UsbSettings> &candidates = default_usb_candidates(),
+                   const size_t frames_per_round = 20,
+                   const size_t rounds = 5,
+                   std::vector<CalibrationResult> *all_results = nullptr);
+
+//
+// Where calibration results are kept between runs ($HOME/.color_bar_usb)
+//
+std::string default_usb_settings_path();
+
+//
+// The settings file is just lines of "frame_size transfer_size latency_timer_ms" since
+// different strip lengths want different settings. Saving replaces the line for
+// `frame_size` and leaves the rest alone
+//
+bool save_usb_settings(const std::string &path, const size_t frame_size, const UsbSettings &settings);
+
+//
+// Look up the settings for `frame_size`, returns false if there aren't any
+//
+bool load_usb_settings(const std::string &path, const size_t frame_size, UsbSettings &settings);
+
+} // namespace serial
@@ -0,0 +1,45 @@
+#
+# Compositing from Python, run through ctest with the freshly built module on the path
+#
+import unittest
+
+import neopixel_driver as n
+
+
+class CompositorTest(unittest.TestCase):
+    def test_color_alpha(self):
+        color = n.Color(1, 2, 3, 4)
+        self.assertEqual((color.r, color.g, color.b, color.a), (1, 2, 3, 4))
+        self.assertEqual(n.Color(1, 2, 3).a, 255)
+
+        color.a = 128
+        self.assertEqual(color.a, 128)
+
+    def test_half_transparent_layer(self):
+        compositor = n.Compositor(3)
+        base = compositor.add_layer()
+        top = compositor.add_layer()
+        compositor.set_layer(base, [n.Color(0, 0, 200)] * 3)
+        compositor.set_layer(top, [n.Color(200, 0, 0, 128)] * 3)
+
+        #
+        # Half of the red on top of half of the blue, give or take rounding
+        #
+        for color in compositor.composite().colors:
+            self.assertAlmostEqual(color.r, 100, delta=1)
+            self.assertEqual(color.g, 0)
+            self.assertAlmostEqual(color.b, 100, delta=1)
+
+    def test_transparent_layer_does_nothing(self):
+        compositor = n.Compositor(2)
+        base = compositor.add_layer()
+        top = compositor.add_layer()
+        compositor.set_layer(base, [n.Color(10, 20, 30)] * 2)
+        compositor.set_layer(top, [n.Color(200, 200, 200, 0)] * 2)
+
+        for color in compositor.composite().colors:
+            self.assertEqual((color.r, color.g, color.b), (10, 20, 30))
+
+
+if __name__ == "__main__":
+    unittest.main()
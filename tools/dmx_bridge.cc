@@ -0,0 +1,42 @@
+//
+// Drive the strip from a lighting console. LEDs are laid out across universes 170 at a
+// time, starting at the first universe
+//
+//     dmx_bridge <led count> [sacn|artnet] [first universe]
+//
+// Runs until it's killed
+//
+#include <iostream>
+#include <string>
+
+#include "../color_bar/dmx_receiver.hh"
+#include "../color_bar/frame_output.hh"
+#include "../color_bar/neopixel_comms.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "usage: dmx_bridge <led count> [sacn|artnet] [first universe]" << std::endl;
+        return 1;
+    }
+
+    const size_t led_count = std::stoul(argv[1]);
+    const bool use_artnet = argc > 2 && std::string(argv[2]) == "artnet";
+    const uint16_t first_universe = argc > 3 ? std::stoul(argv[3]) : (use_artnet ? 0 : 1);
+
+    serial::SerialConnection serial;
+    NeopixelComms comms(serial.configure_spi_defaults(NeopixelComms::best_spi_clock_hz()));
+    LatestFrameOutput output(serial, comms, led_count);
+
+    DmxReceiver receiver(use_artnet ? DmxReceiver::Protocol::ARTNET : DmxReceiver::Protocol::SACN,
+                         DmxReceiver::contiguous_mapping(led_count, first_universe), output);
+    if (receiver.is_open() == false)
+    {
+        return 1;
+    }
+
+    receiver.run();
+    return 0;
+}
@@ -0,0 +1,39 @@
+#!/bin/bash
+#
+# Release build with profile guided optimization. Builds the core libraries with
+# instrumentation, runs the encoding and playback benchmarks to train them, then
+# builds them again with the profiles.
+#
+#     tools/pgo_build.sh [build dir] [extra cmake arguments...]
+#
+# The build dir defaults to build_pgo. Anything after it goes to cmake, like
+# -Dftdi_driver=/path/to/libftd2xx.a
+#
+set -e
+
+SOURCE_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=$(mkdir -p "${1:-build_pgo}" && cd "${1:-build_pgo}" && pwd)
+shift || true
+PROFILE_DIR="$BUILD_DIR/pgo_profiles"
+
+#
+# Old profiles from a different build would only confuse things
+#
+rm -rf "$PROFILE_DIR"
+
+cmake -S "$SOURCE_DIR" -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release -DPGO_MODE=GENERATE \
+      -DPGO_PROFILE_DIR="$PROFILE_DIR" "$@"
+cmake --build "$BUILD_DIR" -j"$(nproc)"
+
+#
+# The training run. Encoding (with and without dithering), generating frames and
+# pushing them through play_frames is where the time goes when a strip is running
+#
+"$BUILD_DIR/encode_soak" 1000 5000
+"$BUILD_DIR/encode_soak" 144 20000
+"$BUILD_DIR/frame_alloc" 1000 200
+"$BUILD_DIR/dither_fps" 1000 2
+"$BUILD_DIR/precompute_show" 1000 60 30
+
+cmake -S "$SOURCE_DIR" -B "$BUILD_DIR" -DPGO_MODE=USE
+cmake --build "$BUILD_DIR" -j"$(nproc)"
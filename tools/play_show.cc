@@ -0,0 +1,137 @@
+//
+// Streams a show file (see tools/render_show.cc) out to the strip. The frames are
+// already encoded, so all this does is hand bytes from the mapping to write_data
+//
+//     play_show <show file> [--max-speed] [--loops N] [--dry-run] [--trace <trace file>]
+//
+// By default every frame is held for as long as it asks, with --max-speed they go back
+// to back. --dry-run writes to a transport that throws everything away, which is handy
+// for seeing how fast a box can go without a strip plugged in. --trace saves when each
+// frame was picked up and written as Chrome trace JSON (see serial::trace)
+//
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../ftd2xx_driver/serial.hh"
+#include "../ftd2xx_driver/show_file.hh"
+#include "../ftd2xx_driver/trace.hh"
+
+namespace
+{
+
+void print_usage()
+{
+    std::cout << "usage: play_show <show file> [--max-speed] [--loops N] [--dry-run] [--trace <trace file>]"
+              << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        print_usage();
+        return 1;
+    }
+
+    bool max_speed = false;
+    bool dry_run = false;
+    size_t loops = 1;
+    std::string trace_path;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--max-speed") == 0)
+        {
+            max_speed = true;
+        }
+        else if (std::strcmp(argv[i], "--dry-run") == 0)
+        {
+            dry_run = true;
+        }
+        else if (std::strcmp(argv[i], "--loops") == 0 && i + 1 < argc)
+        {
+            loops = std::stoul(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_path = argv[++i];
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    serial::ShowReader reader(argv[1]);
+    if (reader.is_open() == false)
+    {
+        return 1;
+    }
+
+    std::unique_ptr<serial::SerialConnection> serial = dry_run
+        ? std::unique_ptr<serial::SerialConnection>(
+              new serial::SerialConnection(std::make_shared<serial::NullTransport>()))
+        : std::unique_ptr<serial::SerialConnection>(new serial::SerialConnection());
+
+    //
+    // The frames were encoded for one clock, anything else would garble them
+    //
+    const double clock_hz = serial->configure_spi_defaults(reader.spi_clock_hz());
+    if (clock_hz != reader.spi_clock_hz())
+    {
+        std::cout << "ERROR: show needs a " << reader.spi_clock_hz() << "Hz clock but the device is at "
+                  << clock_hz << "Hz" << std::endl;
+        return 1;
+    }
+
+    serial::trace::enable(trace_path.empty() == false);
+
+    uint64_t bytes = 0;
+    const uint64_t start_ns = serial::now_ns();
+    for (size_t loop = 0; loop < loops; ++loop)
+    {
+        //
+        // Deadlines are kept from the start of the loop, so a slow write doesn't push
+        // every frame after it back
+        //
+        auto next_frame = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < reader.frame_count(); ++i)
+        {
+            serial::trace::ScopedFrame trace_frame;
+            serial::trace::mark(serial::trace::Stage::GENERATED);
+
+            const serial::ShowReader::Frame frame = reader.frame(i);
+            if (serial->write_data(frame.data, frame.size))
+            {
+                serial->metrics().record_frame_written();
+                bytes += frame.size;
+            }
+
+            if (max_speed == false && frame.hold_time_ms > 0)
+            {
+                next_frame += std::chrono::milliseconds(frame.hold_time_ms);
+                std::this_thread::sleep_until(next_frame);
+            }
+        }
+    }
+    serial->flush();
+    const double elapsed_s = (serial::now_ns() - start_ns) / 1E9;
+
+    const serial::MetricsSnapshot m = serial->metrics().snapshot();
+    std::cout << "Played " << m.frames_written << " frames of " << reader.led_count() << " LEDs in " << elapsed_s
+              << "s" << std::endl;
+    std::cout << "  " << m.frames_written / elapsed_s << " frames/s, " << bytes / elapsed_s / 1E6 << " MB/s, "
+              << m.write_errors << " write errors" << std::endl;
+
+    if (trace_path.empty() == false && serial::trace::write_chrome_trace(trace_path) == false)
+    {
+        return 1;
+    }
+    return m.write_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+//
+// Renders an animation into a show file (see ftd2xx_driver/show_file.hh) that
+// play_show can stream out without doing any encoding
+//
+//     render_show <show file> <led_count> ramp <percent_start> <percent_end> <duration_ms> [step_count]
+//     render_show <show file> <led_count> fade <R,G,B> <R,G,B> <duration_ms> [step_count]
+//
+// Frames are encoded for the clock NeopixelComms::best_spi_clock_hz() ends up at, which
+// is what play_show will set the device to
+//
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "../color_bar/neopixel_comms.hh"
+#include "../ftd2xx_driver/serial.hh"
+#include "../ftd2xx_driver/show_file.hh"
+
+namespace
+{
+
+void print_usage()
+{
+    std::cout << "usage: render_show <show file> <led_count> ramp <percent_start> <percent_end> <duration_ms> "
+                 "[step_count]" << std::endl;
+    std::cout << "       render_show <show file> <led_count> fade <R,G,B> <R,G,B> <duration_ms> [step_count]"
+              << std::endl;
+}
+
+bool parse_color(const std::string &text, animations::Color &color)
+{
+    unsigned int r, g, b;
+    if (std::sscanf(text.c_str(), "%u,%u,%u", &r, &g, &b) != 3 || r > 255 || g > 255 || b > 255)
+    {
+        std::cout << "ERROR: colors look like 255,0,0, not " << text << std::endl;
+        return false;
+    }
+    color = animations::Color(r, g, b);
+    return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 7)
+    {
+        print_usage();
+        return 1;
+    }
+
+    const std::string path = argv[1];
+    const size_t led_count = std::stoul(argv[2]);
+    const std::string animation = argv[3];
+    const double duration_ms = std::stod(argv[6]);
+    const size_t step_count = argc > 7 ? std::stoul(argv[7]) : 100;
+    if (led_count == 0)
+    {
+        std::cout << "ERROR: there has to be at least one LED" << std::endl;
+        return 1;
+    }
+
+    std::vector<animations::Frame> frames;
+    if (animation == "ramp")
+    {
+        animations::green_percent_bar_ramp_into(std::stod(argv[4]), std::stod(argv[5]), led_count, duration_ms,
+                                                step_count, frames);
+    }
+    else if (animation == "fade")
+    {
+        animations::Color start_color;
+        animations::Color end_color;
+        if (parse_color(argv[4], start_color) == false || parse_color(argv[5], end_color) == false)
+        {
+            return 1;
+        }
+        animations::Frame start;
+        animations::Frame end;
+        start.colors.assign(led_count, start_color);
+        end.colors.assign(led_count, end_color);
+        animations::fade_into(start, end, duration_ms, step_count, frames);
+    }
+    else
+    {
+        print_usage();
+        return 1;
+    }
+
+    //
+    // No device needed, just the clock the device would end up at
+    //
+    const double spi_clock_hz = serial::SerialConnection::spi_clock_hz_for_divisor(
+        serial::SerialConnection::spi_clock_divisor(NeopixelComms::best_spi_clock_hz()));
+    NeopixelComms comms(spi_clock_hz);
+
+    serial::ShowWriter writer(path, spi_clock_hz, led_count);
+    serial::ByteVector_t encoded;
+    for (const animations::Frame &frame : frames)
+    {
+        comms.build_frame_into(frame, encoded);
+        if (writer.append_frame(encoded.data(), encoded.size(), frame.hold_time_ms) == false)
+        {
+            return 1;
+        }
+    }
+    if (writer.finish() == false)
+    {
+        return 1;
+    }
+
+    std::cout << "Rendered " << frames.size() << " frames of " << led_count << " LEDs at " << spi_clock_hz
+              << "Hz into " << path << std::endl;
+    return 0;
+}
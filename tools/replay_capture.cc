@@ -0,0 +1,108 @@
+//
+// Feeds a capture file (see SerialConnection::set_capture) back through a
+// SerialConnection that doesn't have any hardware behind it, so real workloads can be
+// profiled on a dev box.
+//
+//     replay_capture <capture file> [--max-speed] [--loops N]
+//
+// By default the writes are spaced out the same way they were when they were captured,
+// with --max-speed they go back to back
+//
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../ftd2xx_driver/capture.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+namespace
+{
+
+void print_usage()
+{
+    std::cout << "usage: replay_capture <capture file> [--max-speed] [--loops N]" << std::endl;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        print_usage();
+        return 1;
+    }
+
+    const std::string path = argv[1];
+    bool max_speed = false;
+    size_t loops = 1;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--max-speed") == 0)
+        {
+            max_speed = true;
+        }
+        else if (std::strcmp(argv[i], "--loops") == 0 && i + 1 < argc)
+        {
+            loops = std::stoul(argv[++i]);
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    serial::CaptureReader reader(path);
+    if (reader.is_open() == false)
+    {
+        return 1;
+    }
+
+    auto transport = std::make_shared<serial::NullTransport>();
+    const serial::SerialConnection serial(transport);
+
+    const uint64_t start_ns = serial::now_ns();
+    for (size_t loop = 0; loop < loops; ++loop)
+    {
+        reader.rewind();
+
+        //
+        // Everything is relative to the first record in the capture and when this
+        // loop started, so a slow write doesn't push every later one back
+        //
+        const auto loop_start = std::chrono::steady_clock::now();
+        uint64_t first_timestamp_ns = 0;
+
+        serial::CaptureReader::Record record;
+        while (reader.next(record))
+        {
+            if (first_timestamp_ns == 0)
+            {
+                first_timestamp_ns = record.timestamp_ns;
+            }
+
+            if (max_speed == false)
+            {
+                std::this_thread::sleep_until(
+                    loop_start + std::chrono::nanoseconds(record.timestamp_ns - first_timestamp_ns));
+            }
+
+            serial.write_data(record.data, record.size);
+        }
+    }
+    const double elapsed_s = (serial::now_ns() - start_ns) / 1E9;
+
+    const serial::MetricsSnapshot m = serial.metrics().snapshot();
+    std::cout << "Replayed " << m.writes << " writes (" << m.bytes_written << " bytes) in "
+              << elapsed_s << "s" << std::endl;
+    std::cout << "  " << m.writes / elapsed_s << " writes/s, "
+              << m.bytes_written / elapsed_s / 1E6 << " MB/s" << std::endl;
+    std::cout << "  write latency p50 " << serial::MetricsSnapshot::percentile_us(m.write_latency_us, 0.5)
+              << "us, p99 " << serial::MetricsSnapshot::percentile_us(m.write_latency_us, 0.99)
+              << "us, max " << m.write_latency_max_us << "us" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+//
+// Drive the strip from a shared memory frame channel (see color_bar/shm_channel.hh) that
+// some other process on this box is publishing into
+//
+//     shm_bridge <channel name>
+//
+// Runs until it's killed
+//
+#include <iostream>
+
+#include "../color_bar/neopixel_comms.hh"
+#include "../color_bar/shm_channel.hh"
+#include "../ftd2xx_driver/serial.hh"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "usage: shm_bridge <channel name>" << std::endl;
+        return 1;
+    }
+
+    ShmFrameReader reader(argv[1]);
+    if (reader.is_open() == false)
+    {
+        return 1;
+    }
+
+    serial::SerialConnection serial;
+    NeopixelComms comms(serial.configure_spi_defaults(NeopixelComms::best_spi_clock_hz()));
+
+    std::vector<uint8_t> frame;
+    serial::ByteVector_t encoded;
+    serial::ByteVector_t packet;
+    ShmFrameInfo info;
+    while (true)
+    {
+        if (reader.wait_for_frame(100000) == false || reader.read_latest(frame, info) == false)
+        {
+            continue;
+        }
+
+        //
+        // Wire frames are ready to go, pixel frames need encoding first
+        //
+        if (reader.format() == shm::Format::WIRE)
+        {
+            serial.spi_write_data(frame.data(), frame.size(), packet);
+            continue;
+        }
+        comms.build_frame_into(reinterpret_cast<const animations::Color *>(frame.data()),
+                               frame.size() / sizeof(animations::Color), encoded);
+        serial.spi_write_data(encoded.data(), encoded.size(), packet);
+    }
+    return 0;
+}